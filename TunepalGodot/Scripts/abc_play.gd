@@ -0,0 +1,45 @@
+extends Button
+
+# Plays the open tune's midi_sequence through the native synth (TunepalMidi).
+# Results and keyword lists set midi_sequence when they open a tune.
+
+# Optional SoundFont; the synth's built-in tone plays without one
+const SOUNDFONT = "res://data/tunepal.sf2"
+
+var midi_sequence = ""
+var midi = null
+
+func _ready():
+	pressed.connect(_on_pressed)
+	if not ClassDB.class_exists("TunepalMidi"):
+		return
+	var player = AudioStreamPlayer.new()
+	add_child(player)
+	midi = ClassDB.instantiate("TunepalMidi")
+	add_child(midi)
+	midi.attach(player)
+	if FileAccess.file_exists(SOUNDFONT):
+		midi.load_soundfont(SOUNDFONT)
+	midi.finished.connect(_on_finished)
+
+func set_tune(tune: Dictionary):
+	stop_playback()
+	var sequence = tune.get("midi_sequence", "")
+	midi_sequence = sequence if sequence != null else ""
+
+func stop_playback():
+	if midi != null and midi.is_playing():
+		midi.stop()
+	text = "Play"
+
+func _on_pressed():
+	if midi == null:
+		return
+	if midi.is_playing():
+		stop_playback()
+	elif midi.load_sequence(midi_sequence):
+		midi.play()
+		text = "Stop"
+
+func _on_finished():
+	text = "Play"
@@ -26,36 +26,37 @@ func _on_song_button_pressed(button_index: int):
 	if button_to_tune_index.has(button_index) and stuff != null:
 		var tune_index = button_to_tune_index[button_index]
 		if tune_index < stuff.size():
-			var tune_data = stuff[tune_index]
+			# Notation is read from the database only when a tune is opened
+			var tune_data = record_control.fetch_tune(tune_index)
 			# Hide Keywords menu and show ABCMenu with tune data
 			get_node("../../../../KeywordsMenu").visible = false
 			var notation = tune_data.get("notation", "")
 			var title = tune_data.get("title", "")
 			get_node("../../../../ABCMenu/Control/ColorRect/ABC").text = notation
 			get_node("../../../../ABCMenu/Control/ColorRect/Title").text = title
+			get_node("../../../../ABCMenu/Control/ColorRect/Play").set_tune(tune_data)
 			get_node("../../../../ABCMenu").visible = true
 
 func _try_load_data():
 	if waiting_for_data:
 		return
-	waiting_for_data = true
-	# Try to get the record control and its data
-	_attempt_data_fetch()
-
-func _attempt_data_fetch():
 	record_control = get_node_or_null("../../../../RecordMenu/Control")
-	if record_control:
-		var existing_data = record_control.get("query_result")
-		if existing_data != null and existing_data.size() > 0:
-			print("Keywords found database with ", existing_data.size(), " tunes")
-			stuff = existing_data
-			data_loaded = true
-			waiting_for_data = false
-			_show_initial_tunes()
-			return
-	# Data not ready yet, retry
-	await get_tree().create_timer(1.0).timeout
-	_attempt_data_fetch()
+	if record_control == null:
+		return
+	var existing_data = record_control.get("query_result")
+	if existing_data != null and existing_data.size() > 0:
+		_on_database_loaded(existing_data)
+		return
+	# The record screen loads the tunes; show them once it is done
+	waiting_for_data = true
+	record_control.database_loaded.connect(_on_database_loaded, CONNECT_ONE_SHOT)
+
+func _on_database_loaded(data):
+	print("Keywords found database with ", data.size(), " tunes")
+	stuff = data
+	data_loaded = true
+	waiting_for_data = false
+	_show_initial_tunes()
 
 func _refresh_data():
 	# Get fresh reference to the query result
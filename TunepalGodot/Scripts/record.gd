@@ -5,7 +5,7 @@ signal database_loaded(data)
 
 #MENU STUFF
 @onready var record_bus_index
-@onready var spectrum
+@onready var capture
 @onready var timer = $Timer
 @onready var record_button = $Record
 @onready var progress_bar = $RecordingProgress
@@ -17,25 +17,14 @@ var MAX_SAMPLES = 10
 
 var lerped_amplitude = 0.0
 
-#FREQUENCY CONSTANTS
-const fund_frequencies = [123.471, 130.813, 138.59, 146.832, 155.56, 164.814, 174.614, 185, 195.998, 207.65, 220, 233.08, 246.942, 261.626, 277.18, 293.665, 311.13, 329.63, 349.23, 369.99, 392.00, 415.30, 440.00, 466.16, 493.88, 523.25, 554.37, 587.33
-			, 622.25, 659.25, 698.46, 739.99, 783.99, 830.61, 880.00, 932.33, 987.77, 1046.50, 1108.73, 1174.66, 1244.51, 1318.51, 1396.91, 1479.98, 1567.98, 1661.22, 1760.00, 1864.66, 1975.53, 2093.00, 2217.46, 2349.32, 2489.02, 2637.02, 2793.83, 2959.96, 3135.96, 3322.44, 3520, 3729.31, 3951.07, 4186.01, 4434.92, 4698.63, 4978.03, 5274.04, 5587.65, 5919.91, 6271.93, 6644.88, 7040, 7458.62, 7902.13]
-const spellings = ["B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B", "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B"]
-
 #DB STUFFrecord
 @onready var db = SQLite.new()
 @onready var db_name = "res://data/tunepal"
 @onready var query_result
 
-#THREAD STUFF
-@onready var thread_count = OS.get_processor_count()
-
 #NOTE STUFF
 @onready var confidences
-@onready var current_notes
 @onready var note_string : String
-var current_time
-var temp_notes
 
 # Tunepal extension only available on desktop for now
 var tunepal = null
@@ -136,35 +125,71 @@ func _ready():
 	
 	
 	record_bus_index = AudioServer.get_bus_index("Record")
-	# record_effect = AudioServer.get_bus_effect(record_bus_index, 1)
-	
-	AudioServer.get_bus_effect(record_bus_index, 0).set_buffer_length(.1)
-	AudioServer.get_bus_effect(record_bus_index, 0).tap_back_pos = .05
-	spectrum = AudioServer.get_bus_effect_instance(record_bus_index, 0)
-	
-	
+	# Raw microphone frames; the extension segments them into notes
+	capture = AudioServer.get_bus_effect(record_bus_index, 0)
 	
-	
-	#print(spellings.size(), " ", fund_frequencies.size())
+	if tunepal != null:
+		# Search keys stream into the extension on a background thread
+		tunepal.corpus_progress.connect(_on_corpus_progress)
+		tunepal.corpus_ready.connect(_on_corpus_ready)
+		record_button.disabled = true
+		print("Loading corpus from: ", db_name)
+		tunepal.load_corpus(db_name, 2)
+	else:
+		load_rows()
+
+func _on_corpus_progress(loaded, total):
+	record_button.text = "Loading tunes %d%%" % int(100.0 * loaded / max(total, 1))
+
+func _on_corpus_ready(count):
+	record_button.disabled = false
+	record_button.text = "Record"
+	# Light rows only; fetch_tune() reads the rest when a tune is opened
+	query_result = tunepal.get_tune_rows()
+	if count > 0:
+		print("Database loaded with ", count, " tunes")
+		database_loaded.emit(query_result)
+	else:
+		print("WARNING: Database query returned no results!")
+
+# Without the extension: the same light columns, read directly
+# source = 2 norbeck
+func load_rows():
 	print("Opening database at: ", db_name)
 	db.path = db_name
-	var open_result = db.open_db()
-	print("Database open result: ", open_result)
 	db.read_only = true
-	# source = 2 norbeck
-	print("Running query...")
-	var query_success = db.query("select tuneindex.id as id, midi_sequence, tune_type, time_sig, notation, source.id as sourceid, shortName, url, source.source as sourcename, title, alt_title, tunepalid, x, midi_file_name, key_sig, search_key from tuneindex, tunekeys, source where tunekeys.tuneid = tuneindex.id and tuneindex.source = source.id and source.id = 2;")
-	print("Query success: ", query_success)
-	await get_tree().create_timer(1.0).timeout
+	if not db.open_db():
+		push_error("Could not open database: " + db_name)
+		return
+	db.query("select tuneindex.id as id, time_sig, title, tune_type, key_sig, shortName from tuneindex, tunekeys, source where tunekeys.tuneid = tuneindex.id and tuneindex.source = source.id and source.id = 2 order by tuneindex.id;")
 	query_result = db.query_result
-	print("Query result size: ", query_result.size() if query_result else "null")
 	db.close_db()
 	if query_result and query_result.size() > 0:
 		print("Database loaded with ", query_result.size(), " tunes")
 		database_loaded.emit(query_result)
 	else:
 		print("WARNING: Database query returned no results!")
-	
+
+# All columns of a tune (notation, midi_sequence, ...) by its index in query_result
+func fetch_tune(index: int) -> Dictionary:
+	if tunepal != null:
+		return tunepal.fetch_tune(index)
+	var tune = query_result[index].duplicate()
+	db.path = db_name
+	db.read_only = true
+	if db.open_db():
+		db.query_with_bindings("select notation, midi_sequence, midi_file_name, url, alt_title from tuneindex where id = ?;", [tune["id"]])
+		if db.query_result.size() > 0:
+			tune.merge(db.query_result[0], true)
+		db.close_db()
+	return tune
+
+# Bars of the notation a result's match covers; empty when not known
+func locate_match(notation, start: int, end: int) -> Dictionary:
+	if tunepal == null or notation == null or start < 0:
+		return {}
+	return tunepal.locate_in_notation(notation, start, end)
+
 func _process(delta):
 	#update_amplitude()
 	pass
@@ -175,99 +200,7 @@ func _physics_process(_delta):
 		# Update progress bar during recording
 		var elapsed = 10.0 - timer.get_time_left()
 		progress_bar.value = elapsed
-
-		if current_time == null:
-			current_time = timer.get_time_left()
-	  	
-		var biggest_mag = 0
-		var big_freqs = []
-		var minIndex = -1
-		var minDiff = 1.79769e308
-		var spec_range = 2
-		var percent = 0.001
-		
-		# var s = ""
-		for i in range(100,8000,spec_range):
-			var f = spectrum.get_magnitude_for_frequency_range(i,i+spec_range)[0]
-			# s += str(f) + ", "
-			if f > biggest_mag:
-				biggest_mag = spectrum.get_magnitude_for_frequency_range(i,i+spec_range)[0]
-				minIndex = -1
-				minDiff = 1.79769e308
-				for j in range(0,fund_frequencies.size()):
-					var diff = abs(i+(spec_range/2) - fund_frequencies[j])
-					if (diff < minDiff):
-						minDiff = diff
-						minIndex = j
-				big_freqs.append({"note" : spellings[minIndex], "frequency" : i+(spec_range/2), "magnitude" : spectrum.get_magnitude_for_frequency_range(i,i+spec_range)[0]})
-				var temp_freqs = []
-				for freq in big_freqs:
-					temp_freqs.append(freq)
-				for j in big_freqs:
-					if (biggest_mag - j.magnitude) / biggest_mag > percent:
-						temp_freqs.erase(j)
-				big_freqs = temp_freqs
-			elif (biggest_mag - spectrum.get_magnitude_for_frequency_range(i,i+spec_range)[0]) / biggest_mag < percent:
-				minIndex = -1
-				minDiff = 1.79769e308
-				for j in range(0,fund_frequencies.size()):
-					var diff = abs(i+(spec_range/2) - fund_frequencies[j])
-					if (diff < minDiff):
-						minDiff = diff
-						minIndex = j
-				big_freqs.append({"note" : spellings[minIndex], "frequency" : i+(spec_range/2), "magnitude" : spectrum.get_magnitude_for_frequency_range(i,i+spec_range)[0]})
-		#BIG FREQS WAS USED TO SEE THE TOP FREQUENCIES BEING DETECTED, NOT JUST THE LOUDEST FREQUENCY. HOWEVER,
-		#TESTING DIDN'T LEAD ANYWHERE. :(	
-		# print(s)
-		#for freq in big_freqs:
-			#print(freq)
-		##print()
-		var frequency = 0
-		var magnitude = 0
-		for freq in big_freqs:
-			if freq.magnitude > magnitude:
-				magnitude = freq.magnitude
-				frequency = freq.frequency
-		minIndex = -1
-		minDiff = 1.79769e308
-		
-		for i in range(0,fund_frequencies.size()):
-			var diff = abs(frequency - fund_frequencies[i])
-			if (diff < minDiff):
-				minDiff = diff
-				minIndex = i
-		
-		if magnitude > 0.001:
-			print(spellings[minIndex], " ", frequency, " Hz ", magnitude)
-			if temp_notes.size() != 0:
-				var check = false
-				for note in temp_notes:
-					if note.note == spellings[minIndex]:
-						check = true
-						note.count += 1
-						if note.count == 2:
-							temp_notes = []
-							if current_notes.size() == 0:
-								current_time = current_time - timer.get_time_left()
-								current_notes.append({"note" : spellings[minIndex], "time" : current_time})
-								print("ENTERED")
-								current_time = timer.get_time_left()
-							elif current_notes[current_notes.size()-1]["note"] != spellings[minIndex]:
-								current_time = current_time - timer.get_time_left()
-								current_notes.append({"note" : spellings[minIndex], "time" : current_time})
-								print("ENTERED")
-								current_time = timer.get_time_left()
-							else:
-								current_time = current_time - timer.get_time_left()
-								current_notes[current_notes.size()-1]["time"] += current_time
-								print("EXTENDED")
-								current_time = timer.get_time_left()
-				if check == false:
-					temp_notes.append({"note" : spellings[minIndex], "count" : 1})
-			else:
-				temp_notes.append({"note" : spellings[minIndex], "count" : 1})
-		else:
-			current_time = timer.get_time_left()
+		feed_segmenter()
 		
 	if active and stop:
 		active = false
@@ -294,8 +227,9 @@ func start_recording():
 	if stop:
 		stop = false
 		return
-	current_notes = []
-	temp_notes = []
+	capture.clear_buffer()
+	if tunepal != null:
+		tunepal.reset_segmenter(AudioServer.get_mix_rate())
 	record_button.text = "Recording..."
 	# Show and reset progress bar
 	progress_bar.value = 0
@@ -311,62 +245,28 @@ func stop_recording():
 	# Hide progress bar during processing
 	progress_bar.visible = false
 	confidences = []
-	var sorted_notes = []
-	for i in range(current_notes.size()):
-		if current_notes[i].time >= 0.1:
-			sorted_notes.append(current_notes[i])
-		elif i != 0:
-			current_notes[i-1].time += current_notes[i].time
-			if current_notes[i-1].time >= 0.1 and current_notes[i-1] not in sorted_notes:
-				sorted_notes.append(current_notes[i])
-	current_notes = []
-	for note in sorted_notes:
-		current_notes.append(note)
-	var bins = group_notes(sorted_notes)
-	var average_time
-	var largest = 0
-	for bin in bins:
-		print("BIN")
-		var count = 0
-		var average = 0
-		for note in bin:
-			print(note.note, " ", note.time)
-			average += note.time
-			count += 1
-		if count > largest:
-			largest = count
-			print(average, " ", bin.size())
-			average_time = (average / bin.size())
-	print("AVERAGE TIME: ", average_time)
-	note_string = create_string(current_notes, average_time)
+	if tunepal == null:
+		# Segmentation and search are native; without the extension there is no query
+		push_warning("Recording needs the Tunepal extension")
+		record_button.text = "Record"
+		return
+	# Notes were segmented while recording; close the last one and take the query
+	tunepal.finish_segmenter()
+	for note in tunepal.get_note_events():
+		print(note.note, " ", note.duration)
+	print("AVERAGE TIME: ", tunepal.get_unit_length())
+	note_string = tunepal.get_segmented_query()
 	print(note_string)
 	var time = Time.get_ticks_msec()
 	#note_string = "AFADGGGAGFDDEFDCAFADGGGAGGGBCDBGAGFFDGGGAGFDEFDCAFFDGGGAGGGDGGGAGFEDDD"
 	#note_string = "DDEBBABBEBBBABDBAGFDADBDADFDADDAF"
 	# note_string = "ADBGGABGDBCADDGABGABCBABDABEDBGGABGABCADGGDBGACBACBGGGBGDGEGDG"
 	print(note_string.length())
-	var length = float(query_result.size()) / float(thread_count)
-	var threads = []
+	# Native search; repeated and extended queries are served from its cache
+	for result in tunepal.search(note_string, 100):
+		var row = query_result[result["index"]]
+		confidences.append({"confidence" : result["confidence"], "index" : result["index"], "id" : row["id"], "title" : row["title"], "shortName" : row["shortName"], "tune_type" : row["tune_type"], "key_sig" : row["key_sig"], "start" : result.get("start", -1), "end" : result.get("end", -1)})
 	
-	for i in thread_count:
-		var thread = Thread.new()
-		threads.append(thread)
-	
-	for i in threads.size():
-		var callable
-		callable = Callable(self,"search").bind(int(i*length),int((i+1)*length),int(i))
-		threads[i].start(callable)
-
-	var return_array = []
-	for i in threads.size():
-		var return_value = threads[i].wait_to_finish()
-		return_array.append(return_value)
-	
-	for array in return_array:
-		for i in array:
-			confidences.append(i)
-	
-	confidences.sort_custom(d_sort)
 	get_node("../../ResultMenu").visible = true
 	get_node("../").visible = false
 	get_node("../../ResultMenu/Control/ScrollContainer/Songs").delete()
@@ -374,68 +274,13 @@ func stop_recording():
 	record_button.text = "Record"
 	print("Time = " + String.num(((float(Time.get_ticks_msec()) - float(time))/1000), 3) + " sec")
 
-func group_notes(notes):
-	var grouped_notes
-	# Sort the notes based on their time values
-	notes.sort_custom(t_sort)
-	grouped_notes = []
-	var current_bin = []
-	var current_average = 0
-	for note in notes:
-		@warning_ignore("shadowed_variable")
-		var current_time = note["time"]
-		if current_average == 0:
-			current_average = current_time
-		#print("(", current_average, " - ", current_time, ") / ", current_average, " = ", (abs(current_average - current_time) / current_average))
-		if abs((current_average - current_time) / current_average) <= .33:
-			# Add the note to the current bin
-			current_bin.append(note)
-			current_average = 0
-			for stuff in current_bin:
-				current_average += stuff.time
-			current_average = current_average / current_bin.size()
-			#print("CURRENT AVERAGE = ", current_average)
-		else:
-			# Start a new bin for notes played at a different time
-			current_average = 0
-			grouped_notes.append(current_bin)
-			current_bin = [note]
-	
-	# Add the last bin to the grouped notes
-	grouped_notes.append(current_bin)
-	return grouped_notes
-
-func create_string(notes, time):
-	var string : String
-	for note in notes:
-		var amount = note.time / time
-		if amount < 1:
-			amount = 1
-		#print(note.note, " ", amount)
-		for i in range(amount):
-			string = string + note.note
-	return string
-	
-func search(start, end, thread):
-	print("Start: " + str(start) + "\tEnd:" + str(end))
-	var info = []
-	for id in range(start, end):
-		var search_key = query_result[id]["search_key"]
-		if !search_key.length() < 50:
-			var ed = tunepal.edSubstring(note_string, search_key, thread)
-			var confidence = 1.0 - (ed / float(note_string.length()))
-			info.append({"confidence" : confidence, "id" : query_result[id]["id"], "title" : query_result[id]["title"], "notation" : query_result[id]["notation"], "midi_sequence" : query_result[id]["midi_sequence"], "shortName" : query_result[id]["shortName"], "tune_type" : query_result[id]["tune_type"], "key_sig" : query_result[id]["key_sig"]})
-	return info
-			
-static func d_sort(a, b):
-	if a["confidence"] > b["confidence"]:
-		return true
-	return false
-
-static func t_sort(a, b):
-	if a["time"] < b["time"]:
-		return true
-	return false
+# Hand everything captured since the last call to the segmenter
+func feed_segmenter():
+	var frames = capture.get_frames_available()
+	if frames > 0:
+		var buffer = capture.get_buffer(frames)
+		if tunepal != null:
+			tunepal.push_audio(buffer)
 
 func _on_record_pressed():
 	if !active:
@@ -444,6 +289,7 @@ func _on_record_pressed():
 		stop = true
 
 func _on_timer_timeout():
+	feed_segmenter()
 	record_button.text = "Processing..."
 	await get_tree().create_timer(.5).timeout
 	stop_recording()
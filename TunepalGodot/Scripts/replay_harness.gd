@@ -0,0 +1,190 @@
+extends Node
+## Replay harness: feeds WAV fixtures through the native pipeline (pitch
+## tracking and segmentation, then corpus search) and writes a JSON report
+## with per-stage latency percentiles, top-1/top-10 hit rates and throughput.
+##
+## A fixture directory holds WAV files and a manifest.json describing them:
+##   [{"file": "fiddle_01.wav", "tune_id": 1234, "category": "fiddle"}, ...]
+## (see "Accuracy Benchmark Dataset" in docs/ALGORITHMS_IMPLEMENTATION_PLAN.md)
+##
+## Run headless from the project directory:
+##   godot --headless --path TunepalGodot res://Scenes/replay_harness.tscn -- \
+##       --fixtures=res://test_data/replay --out=user://replay_report.json
+##
+## --synthesize=N first renders N corpus tunes as harmonic tones into the
+## fixture directory and adds them to its manifest (category "synthetic").
+
+const DB_NAME = "res://data/tunepal"
+const SAMPLE_RATE = 44100
+const SYNTH_NOTES = 32
+const SYNTH_UNIT = 0.15
+# One octave from D4; sharps spell down, so F and C are played as F# and C#
+const SYNTH_FREQUENCIES = {"D": 293.66, "E": 329.63, "F": 369.99, "G": 392.0, "A": 440.0, "B": 493.88, "C": 554.37}
+
+var fixtures_dir = "res://test_data/replay"
+var out_path = "user://replay_report.json"
+var synthesize = 0
+var max_results = 10
+
+func _ready():
+	parse_args()
+	if not ClassDB.class_exists("Tunepal"):
+		push_error("Tunepal extension not available")
+		get_tree().quit(1)
+		return
+	var tunepal = ClassDB.instantiate("Tunepal")
+
+	var tunes = load_corpus(tunepal)
+	if tunes.is_empty():
+		push_error("No tunes loaded from " + DB_NAME)
+		tunepal.free()
+		get_tree().quit(1)
+		return
+
+	if synthesize > 0:
+		synthesize_fixtures(tunes, synthesize)
+
+	var manifest = read_manifest()
+	if manifest.is_empty():
+		push_error("No fixtures listed in " + fixtures_dir.path_join("manifest.json"))
+		tunepal.free()
+		get_tree().quit(1)
+		return
+
+	var paths = PackedStringArray()
+	var ids = PackedInt32Array()
+	for entry in manifest:
+		paths.append(fixtures_dir.path_join(entry["file"]))
+		ids.append(int(entry["tune_id"]))
+
+	print("Replaying %d fixtures against %d tunes..." % [paths.size(), tunepal.get_corpus_size()])
+	var report = tunepal.replay_fixtures(paths, ids, max_results)
+	report["fixture_dir"] = fixtures_dir
+	report["categories"] = category_rates(manifest, report["results"])
+
+	var file = FileAccess.open(out_path, FileAccess.WRITE)
+	if file == null:
+		push_error("Could not write report: " + out_path)
+	else:
+		file.store_string(JSON.stringify(report, "  "))
+		file.close()
+
+	print("top-1 %.3f  top-10 %.3f  %.1f fixtures/s  total p50 %.1f ms  p90 %.1f ms" % [
+			report["top1_rate"], report["top10_rate"], report["fixtures_per_second"],
+			report["stages"]["total"].get("p50", 0.0), report["stages"]["total"].get("p90", 0.0)])
+	print("Report written to ", ProjectSettings.globalize_path(out_path))
+	tunepal.free()
+	get_tree().quit(0)
+
+func parse_args():
+	for arg in OS.get_cmdline_user_args():
+		if arg.begins_with("--fixtures="):
+			fixtures_dir = arg.get_slice("=", 1)
+		elif arg.begins_with("--out="):
+			out_path = arg.get_slice("=", 1)
+		elif arg.begins_with("--synthesize="):
+			synthesize = int(arg.get_slice("=", 1))
+		elif arg.begins_with("--max-results="):
+			max_results = int(arg.get_slice("=", 1))
+
+# Same tune set as the record screen (source 2)
+func load_corpus(tunepal) -> Array:
+	var db = SQLite.new()
+	db.path = DB_NAME
+	db.read_only = true
+	if not db.open_db():
+		return []
+	db.query("select tuneindex.id as id, search_key, time_sig from tuneindex, tunekeys where tunekeys.tuneid = tuneindex.id and tuneindex.source = 2;")
+	var rows = db.query_result
+	db.close_db()
+
+	var ids = PackedInt32Array()
+	var keys = PackedStringArray()
+	var time_sigs = PackedStringArray()
+	for row in rows:
+		ids.append(row["id"])
+		keys.append(row["search_key"] if row["search_key"] != null else "")
+		time_sigs.append(row["time_sig"] if row["time_sig"] != null else "")
+	tunepal.clear_corpus()
+	tunepal.add_tunes(ids, keys, time_sigs)
+	return rows
+
+func read_manifest() -> Array:
+	var path = fixtures_dir.path_join("manifest.json")
+	if not FileAccess.file_exists(path):
+		return []
+	var parsed = JSON.parse_string(FileAccess.get_file_as_string(path))
+	return parsed if parsed is Array else []
+
+func category_rates(manifest: Array, results: Array) -> Dictionary:
+	var categories = {}
+	for i in range(results.size()):
+		var category = manifest[i].get("category", "uncategorized")
+		if not categories.has(category):
+			categories[category] = {"fixtures": 0, "top1": 0, "top10": 0}
+		if results[i].has("error"):
+			continue
+		var rank = results[i]["rank"]
+		categories[category]["fixtures"] += 1
+		categories[category]["top1"] += 1 if rank == 0 else 0
+		categories[category]["top10"] += 1 if rank >= 0 and rank < 10 else 0
+	for category in categories:
+		var stats = categories[category]
+		stats["top1_rate"] = stats["top1"] / float(max(stats["fixtures"], 1))
+		stats["top10_rate"] = stats["top10"] / float(max(stats["fixtures"], 1))
+	return categories
+
+# Renders the opening of evenly spaced corpus tunes; runs of a letter in the
+# search key become one held note
+func synthesize_fixtures(tunes: Array, count: int):
+	DirAccess.make_dir_recursive_absolute(fixtures_dir)
+	var manifest = read_manifest()
+	var candidates = []
+	for row in tunes:
+		if row["search_key"] != null and row["search_key"].length() >= 50:
+			candidates.append(row)
+	var stride = max(1, candidates.size() / count)
+	for n in range(min(count, candidates.size())):
+		var row = candidates[n * stride]
+		var file_name = "synthetic_%d.wav" % row["id"]
+		save_wav(fixtures_dir.path_join(file_name), render_key(row["search_key"].substr(0, SYNTH_NOTES)))
+		manifest.append({"file": file_name, "tune_id": row["id"], "category": "synthetic"})
+		print("Synthesized ", file_name)
+
+	var file = FileAccess.open(fixtures_dir.path_join("manifest.json"), FileAccess.WRITE)
+	file.store_string(JSON.stringify(manifest, "  "))
+	file.close()
+
+func render_key(key: String) -> PackedFloat32Array:
+	var samples = PackedFloat32Array()
+	var i = 0
+	while i < key.length():
+		var letter = key[i]
+		var run = 1
+		while i + run < key.length() and key[i + run] == letter:
+			run += 1
+		i += run
+		if not SYNTH_FREQUENCIES.has(letter):
+			continue
+		var frequency = SYNTH_FREQUENCIES[letter]
+		var length = int(run * SYNTH_UNIT * SAMPLE_RATE)
+		var fade = int(0.01 * SAMPLE_RATE)
+		for s in range(length):
+			var t = s / float(SAMPLE_RATE)
+			var value = 0.0
+			for h in range(1, 5):
+				value += sin(TAU * frequency * h * t) / h
+			samples.append(0.25 * value * min(1.0, min(s, length - s) / float(fade)))
+	return samples
+
+func save_wav(path: String, samples: PackedFloat32Array):
+	var data = PackedByteArray()
+	data.resize(samples.size() * 2)
+	for i in range(samples.size()):
+		data.encode_s16(i * 2, int(clamp(samples[i], -1.0, 1.0) * 32767.0))
+	var wav = AudioStreamWAV.new()
+	wav.format = AudioStreamWAV.FORMAT_16_BITS
+	wav.mix_rate = SAMPLE_RATE
+	wav.stereo = false
+	wav.data = data
+	wav.save_to_wav(path)
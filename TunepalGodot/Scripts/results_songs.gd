@@ -11,8 +11,18 @@ func _process(_delta):
 	for button in buttons:
 		if button.button_pressed:
 			get_node("../../../../ResultMenu").visible = false
-			get_node("../../../../ABCMenu/Control/ColorRect/ABC").text = information[button.index]["notation"]
-			get_node("../../../../ABCMenu/Control/ColorRect/Title").text = information[button.index]["title"]
+			# Notation is read from the database only when a tune is opened
+			var record = get_node("../../../../RecordMenu/Control")
+			var result = information[button.index]
+			var tune = record.fetch_tune(result["index"])
+			get_node("../../../../ABCMenu/Control/ColorRect/ABC").text = tune.get("notation", "")
+			get_node("../../../../ABCMenu/Control/ColorRect/Play").set_tune(tune)
+			var title = str(result["title"])
+			# Where the played phrase matched
+			var location = record.locate_match(tune.get("notation"), result.get("start", -1), result.get("end", -1))
+			if location.has("bar"):
+				title += " (bars %d-%d)" % [location["bar"], location["end_bar"]]
+			get_node("../../../../ABCMenu/Control/ColorRect/Title").text = title
 			get_node("../../../../ABCMenu").visible = true
 
 func delete():
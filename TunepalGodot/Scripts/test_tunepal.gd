@@ -21,6 +21,19 @@ func _ready():
 	test_substring_match()
 	test_empty_strings()
 	test_real_tune_patterns()
+	test_long_keys()
+	test_corpus_search()
+	test_query_cache()
+	test_scratch_arena()
+	test_search_batch()
+	test_length_buckets()
+	test_coarse_ranker()
+	test_seeded_search()
+	test_abc_indexer()
+	test_match_location()
+	test_tracing()
+	test_note_segmenter()
+	test_midi_synth()
 
 	# Print summary
 	print("")
@@ -44,6 +57,23 @@ func assert_eq(actual, expected, test_name: String):
 		print("  FAIL: %s (expected %s, got %s)" % [test_name, expected, actual])
 		tests_failed += 1
 
+# Empty corpus in which keys of any length are searched
+func _empty_corpus():
+	tunepal.clear_corpus()
+	tunepal.set_min_key_length(0)
+
+# The three tunes most corpus tests search
+func _load_fixture_corpus():
+	_empty_corpus()
+	tunepal.add_tune(101, "GABCDEDCBAGABCDEDCBA", "6/8")
+	tunepal.add_tune(102, "GAGBAGEGDGAGBAGEGDG", "6/8")
+	tunepal.add_tune(103, "DEFGABCDEFGABC", "4/4")
+
+# Back to an empty corpus with record.gd's minimum key length
+func _reset_corpus():
+	tunepal.clear_corpus()
+	tunepal.set_min_key_length(50)
+
 func test_exact_match():
 	print("\nTest: Exact Match")
 	# When pattern is found exactly in text, edit distance should be 0
@@ -108,6 +138,288 @@ func test_real_tune_patterns():
 	ed = tunepal.edSubstring("GAGBAG", kesh_style, 0)
 	assert_eq(ed, 0, "Kesh-style pattern matched")
 
+func test_long_keys():
+	print("\nTest: Keys Longer Than 400 Notes")
+	# Used to overflow a fixed 400x400 matrix on the stack
+	var long_key = "GABCDEDCBA".repeat(100) + "FFFFEEEE"
+	var ed = tunepal.edSubstring("FFFFEEEE", long_key, 0)
+	assert_eq(ed, 0, "Pattern at the end of a 1008-note key found")
+
+	ed = tunepal.edSubstring("GABCDEDCBA".repeat(50), long_key, 0)
+	assert_eq(ed, 0, "500-note pattern found")
+
+func test_corpus_search():
+	print("\nTest: Native Corpus Search")
+	_load_fixture_corpus()
+	assert_eq(tunepal.get_corpus_size(), 3, "Corpus holds 3 tunes")
+
+	var results = tunepal.search("GAGBAG", 3)
+	assert_eq(results.size(), 3, "Search returns every candidate up to max_results")
+	assert_eq(results[0]["id"], 102, "Best match is the Kesh-style tune")
+	assert_eq(results[0]["distance"], tunepal.edSubstring("GAGBAG", "GAGBAGEGDGAGBAGEGDG", 0), "Distance agrees with edSubstring")
+
+	results = tunepal.search("GAGBAG", 3, PackedStringArray(["4/4"]))
+	assert_eq(results.size(), 1, "Time signature filter limits candidates")
+	assert_eq(results[0]["id"], 103, "Filtered search returns the 4/4 tune")
+	_reset_corpus()
+
+func test_query_cache():
+	print("\nTest: Query Cache")
+	_load_fixture_corpus()
+	tunepal.clear_cache()
+	tunepal.search("GABCD", 3)
+	tunepal.search("GABCD", 3)
+	var stats = tunepal.get_cache_stats()
+	assert_eq(stats["hits"], 1, "Repeated query is a cache hit")
+
+	# Extending a cached query resumes from its rows and scores identically
+	var resumed = tunepal.search("GABCDEDC", 3)
+	assert_eq(tunepal.get_cache_stats()["prefix_hits"], 1, "Extended query resumes from cached prefix")
+	tunepal.clear_cache()
+	var fresh = tunepal.search("GABCDEDC", 3)
+	assert_eq(resumed[0]["distance"], fresh[0]["distance"], "Resumed and fresh scores agree")
+
+	tunepal.set_cache_budget(0)
+	tunepal.search("GABCD", 3)
+	assert_eq(tunepal.get_cache_stats()["entries"], 0, "Zero budget stores nothing")
+	tunepal.set_cache_budget(32 * 1024 * 1024)
+	_reset_corpus()
+
+func test_scratch_arena():
+	print("\nTest: Scratch Arena")
+	_load_fixture_corpus()
+	# Uncached scans on this thread only: locations are traced on the worker pool,
+	# whose arenas warm up whenever a worker first picks up a chunk
+	tunepal.set_cache_budget(0)
+	tunepal.set_match_locations(0)
+	tunepal.search("GAGBAGEGD", 3)
+	var before = tunepal.get_scratch_stats()["scratch_blocks"]
+	for i in range(5):
+		tunepal.search("GAGBAGEGD", 3)
+	assert_eq(tunepal.get_scratch_stats()["scratch_blocks"], before, "Repeated searches allocate no new scratch blocks")
+	assert_eq(tunepal.get_scratch_stats()["bytes"] > 0, true, "Arena memory is kept between searches")
+	tunepal.set_match_locations(10)
+	tunepal.set_cache_budget(32 * 1024 * 1024)
+	_reset_corpus()
+
+func test_search_batch():
+	print("\nTest: Batch Search")
+	_load_fixture_corpus()
+
+	var queries = PackedStringArray(["GAGBAG", "defgab", "CDEDC", ""])
+	var batch = tunepal.search_batch(queries, 2)
+	assert_eq(batch.size(), 4, "One result list per query")
+	for q in range(3):
+		var single = tunepal.search(queries[q], 2)
+		assert_eq(batch[q].size(), single.size(), "Batch and single search return as many results")
+		assert_eq(batch[q][0]["id"], single[0]["id"], "Batch and single search agree on the best tune")
+		assert_eq(batch[q][1]["distance"], single[1]["distance"], "Batch and single search agree on distances")
+	assert_eq(batch[3].size(), 0, "Empty query has no results")
+
+	tunepal.set_coarse_candidates(1)
+	var coarse = tunepal.search_batch(queries, 3)
+	for q in range(3):
+		var single = tunepal.search(queries[q], 3)
+		assert_eq(coarse[q].size(), single.size(), "Batch and single search keep the same coarse candidates")
+		assert_eq(coarse[q][0]["id"], single[0]["id"], "Batch and single search agree under the coarse ranker")
+	tunepal.set_coarse_candidates(0)
+	_reset_corpus()
+
+func test_length_buckets():
+	print("\nTest: Length Buckets")
+	_empty_corpus()
+	# Equal distances: the long key comes first in the corpus, the short one in the layout
+	tunepal.add_tune(201, "GABCDE" + "F".repeat(100), "4/4")
+	tunepal.add_tune(202, "GABCDE" + "F".repeat(10), "4/4")
+	tunepal.add_tune(203, "C".repeat(40), "4/4")
+
+	var buckets = tunepal.get_length_buckets()
+	assert_eq(buckets.size(), 3, "Keys fall into three length buckets")
+	assert_eq(buckets[0]["min_length"], 16, "Shortest bucket first")
+	assert_eq(buckets[2]["max_length"], 106, "Longest bucket last")
+	var tunes = 0
+	for bucket in buckets:
+		tunes += bucket["tunes"]
+	assert_eq(tunes, 3, "Every tune is in a bucket")
+
+	var results = tunepal.search("GABCDE", 2)
+	assert_eq(results[0]["id"], 201, "Ties still go to the earlier tune")
+	assert_eq(results[1]["id"], 202, "Tied tune follows")
+	var batch = tunepal.search_batch(PackedStringArray(["GABCDE"]), 2)
+	assert_eq(batch[0][0]["id"], 201, "Batch search breaks ties the same way")
+
+	# A single add is scanned after the buckets instead of rebuilding them
+	tunepal.add_tune(204, "GABCDE", "4/4")
+	results = tunepal.search("GABCDE", 4)
+	assert_eq(results.size(), 4, "Added tune is searched")
+	assert_eq(results[2]["id"], 204, "Added tune ties by corpus index")
+	tunes = 0
+	for bucket in tunepal.get_length_buckets():
+		tunes += bucket["tunes"]
+	assert_eq(tunes, 3, "Adding a tune does not rebuild the buckets")
+	_reset_corpus()
+
+func test_coarse_ranker():
+	print("\nTest: Coarse Ranker")
+	_load_fixture_corpus()
+
+	assert_eq(tunepal.coarse_rank("GAGBAGEGD", 1), PackedInt32Array([1]), "Coarse ranker keeps the closest tune")
+	tunepal.set_coarse_candidates(1)
+	var results = tunepal.search("GAGBAGEGD", 3)
+	assert_eq(results.size(), 1, "Only coarse candidates are reranked")
+	assert_eq(results[0]["id"], 102, "Reranked result is the exact best match")
+	tunepal.set_coarse_candidates(0)
+
+	var recall = tunepal.measure_coarse_recall(PackedStringArray(["GAGBAG", "DEFGAB"]), 3, 2)
+	assert_eq(recall["recall"], 1.0, "Keeping every tune gives full recall")
+	_reset_corpus()
+
+func test_seeded_search():
+	print("\nTest: Seeded Search")
+	_load_fixture_corpus()
+	tunepal.set_seed_length(4)
+
+	var index = tunepal.build_seed_index()
+	assert_eq(index["symbols"], 20 + 19 + 14 + 3 + 1, "Seed index covers every key")
+	var results = tunepal.search_seeded("GAGBAGEAD", 1)
+	assert_eq(results.size(), 1, "Seeded search returns a hit")
+	assert_eq(results[0]["id"], 102, "Seeded search finds the tune sharing seeds")
+	assert_eq(results[0]["distance"], tunepal.search("GAGBAGEAD", 1)[0]["distance"], "Banded verification matches the full alignment")
+	assert_eq(tunepal.search_seeded("GAGBAGEAD", 3, PackedStringArray(["4/4"])).size(), 0, "Seeded search honours time signature filters")
+
+	tunepal.add_tune(104, "CCCCAAGGFFEEDDC", "4/4")
+	assert_eq(tunepal.search_seeded("AAGGFFEE", 1)[0]["id"], 104, "Seed index is rebuilt after the corpus changes")
+
+	var comparison = tunepal.compare_seeded_search(PackedStringArray(["GAGBAGEGD", "DEFGABC"]), 1)
+	assert_eq(comparison["best_distance_agreement"], 1.0, "Seeded search agrees with the exhaustive scan")
+	tunepal.set_seed_length(6)
+	_reset_corpus()
+
+func test_abc_indexer():
+	print("\nTest: ABC Indexer")
+	var abc = "X:1\nT:Test Reel\nM:4/4\nL:1/8\nK:D\n|:A2 {g}B>c (3def|1 e2:|2 d2|]\n"
+	var indexed = tunepal.index_abc(abc)
+	assert_eq(indexed["search_key"], "AABBCDEFEEAABBCDEFDD", "Repeats, endings, ornaments and durations normalized")
+	assert_eq(indexed["pitches"][7], 78, "Key signature sharpens F")
+	assert_eq(indexed["bars"][19], 3, "Second ending maps back to its bar")
+	assert_eq(indexed["title"], "Test Reel", "Title read from the header")
+
+	_empty_corpus()
+	tunepal.add_tune(101, "GABCDEDCBAGABCDEDCBA", "6/8")
+	tunepal.build_seed_index()
+	var index = tunepal.add_abc_tune(501, abc)
+	assert_eq(index, 1, "ABC tune appended to the corpus")
+	assert_eq(tunepal.search("BCDEFDD", 1)[0]["id"], 501, "Added tune is searchable")
+	assert_eq(tunepal.search_seeded("BCDEFDD", 1)[0]["id"], 501, "Seeded search finds tunes added after the index was built")
+	assert_eq(tunepal.add_abc_tune(502, "X:1\nK:G\nz4|\n"), -1, "Notation without notes is rejected")
+	assert_eq(tunepal.add_abc_tune(503, "X:1\nK:D\nA99999999999|\n"), -1, "Oversized note length is rejected")
+	assert_eq(tunepal.index_abc("X:1\nK:D\nA99999999999|\n")["search_key"], "", "Oversized note length gives no key")
+	assert_eq(tunepal.index_abc("X:1\nL:1/99999999999\nK:D\nAB|\n")["search_key"], "AB", "Oversized unit length is read safely")
+	_reset_corpus()
+
+func test_match_location():
+	print("\nTest: Match Location")
+	_empty_corpus()
+	var abc = "X:1\nT:Located\nM:4/4\nL:1/8\nK:G\nGABc dedB|AGFG E2D2|B2cB AGFE|DEFG A4|]\n"
+	tunepal.add_abc_tune(601, abc)
+	tunepal.add_tune(602, "CCCCCCCCCCCCCCCC", "4/4")
+
+	var results = tunepal.search("CBAXFE", 1)
+	assert_eq(results[0]["id"], 601, "Phrase found in the ABC tune")
+	assert_eq(results[0]["start"], 18, "Match starts at the phrase")
+	assert_eq(results[0]["end"], 24, "Match ends at the phrase")
+	assert_eq(results[0]["ops"], "===X==", "Operations mark the wrong note")
+	var location = tunepal.locate_in_notation(abc, results[0]["start"], results[0]["end"])
+	assert_eq(location["bar"], 3, "Match maps back to its bar")
+	assert_eq(location["end_bar"], 3, "Match ends in the same bar")
+
+	tunepal.set_match_locations(0)
+	assert_eq(tunepal.search("CBAXFE", 1)[0].has("start"), false, "Locations can be turned off")
+	tunepal.set_match_locations(10)
+	_reset_corpus()
+
+func test_tracing():
+	print("\nTest: Tracing")
+	_empty_corpus()
+	tunepal.add_tune(701, "GAGBAGEGDGAGBAGEGDG", "6/8")
+	tunepal.add_tune(702, "DEFGABCDEFGABCDEFGA", "4/4")
+
+	tunepal.clear_trace()
+	tunepal.search("GAGBAG", 1)
+	var path = "user://test_trace.json"
+	assert_eq(tunepal.dump_trace(path)["events"], 0, "Nothing is recorded while tracing is off")
+
+	tunepal.set_tracing(true)
+	tunepal.search("GABCDE", 1)
+	tunepal.set_tracing(false)
+	var dumped = tunepal.dump_trace(path)
+	assert_eq(dumped["events"] > 0, true, "Search spans are recorded")
+	assert_eq(dumped["dropped"], 0, "No spans are dropped")
+
+	var trace = JSON.parse_string(FileAccess.get_file_as_string(path))
+	var names = {}
+	for event in trace["traceEvents"]:
+		if event["ph"] == "X":
+			names[event["name"]] = true
+	assert_eq(names.has("search"), true, "Trace has the search span")
+	assert_eq(names.has("score corpus"), true, "Trace has the scoring span")
+	assert_eq(names.has("hydrate results"), true, "Trace has the hydration span")
+
+	tunepal.clear_trace()
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(path))
+	_reset_corpus()
+
+func test_note_segmenter():
+	print("\nTest: Note Segmenter")
+	# D, E, F# (spelled F) at 44.1 kHz; the last note is twice as long
+	var rate = 44100.0
+	var samples = PackedFloat32Array()
+	for note in [[293.66, 0.2], [329.63, 0.2], [369.99, 0.4]]:
+		var count = int(note[1] * rate)
+		for i in range(count):
+			var fade = min(1.0, min(i, count - i) / 441.0)
+			samples.append(0.5 * fade * sin(TAU * note[0] * i / rate))
+
+	tunepal.reset_segmenter(rate)
+	tunepal.push_samples(samples)
+	tunepal.finish_segmenter()
+	var events = tunepal.get_note_events()
+	assert_eq(events.size(), 3, "One event per note")
+	assert_eq(events[0]["note"], "D", "First note spelled D")
+	assert_eq(tunepal.get_segmented_query(), "DEFF", "Long note repeated by unit length")
+
+	# The same A struck four times, each strike decaying before the next
+	samples = PackedFloat32Array()
+	for note in range(4):
+		var count = int(0.25 * rate)
+		for i in range(count):
+			var envelope = min(1.0, i / 441.0) * exp(-i / rate / 0.2)
+			samples.append(0.5 * envelope * sin(TAU * 440.0 * i / rate))
+
+	tunepal.reset_segmenter(rate)
+	tunepal.push_samples(samples)
+	tunepal.finish_segmenter()
+	assert_eq(tunepal.get_note_events().size(), 4, "Each re-struck note is its own event")
+	assert_eq(tunepal.get_segmented_query(), "AAAA", "Repeated notes are not merged")
+
+	tunepal.reset_segmenter(rate)
+	tunepal.push_samples(PackedFloat32Array([0.0, 0.0, 0.0]))
+	tunepal.finish_segmenter()
+	assert_eq(tunepal.get_segmented_query(), "", "Silence gives an empty query")
+
+func test_midi_synth():
+	print("\nTest: MIDI Synth")
+	var midi = ClassDB.instantiate("TunepalMidi")
+	assert_eq(midi.load_sequence("DEFFGA"), true, "Letters load as a sequence")
+	assert_eq(is_equal_approx(midi.get_length(), 6 * midi.get_note_length()), true, "Sequence lasts one note length per entry")
+	assert_eq(midi.load_sequence("62,64,66"), true, "Note numbers load as a sequence")
+	assert_eq(midi.load_sequence(""), false, "Empty sequence is rejected")
+
+	var bench = midi.benchmark(0.5, 8)
+	assert_eq(bench["max_voices"], 8, "Benchmark uses the requested voice limit")
+	assert_eq(bench["peak_voices"] > 0, true, "Benchmark sounds voices")
+	midi.free()
+
 # Called when run as autoload or standalone scene
 func _enter_tree():
 	if get_parent() == get_tree().root:
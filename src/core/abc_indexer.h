@@ -0,0 +1,585 @@
+/**
+ * ABC Notation to Search Key
+ *
+ * Turns a tune's ABC `notation` into the search_key normalization the
+ * database stores, so tunes added on the device can be searched without a
+ * server-side rebuild:
+ *   - repeats (|: :| ::) are played out and variant endings ([1 |2 :|2)
+ *     taken on the matching pass,
+ *   - grace notes, decorations, chord symbols, annotations and rests are
+ *     dropped, and a chord keeps its highest note,
+ *   - each note is written as round(duration / unit) copies of its letter
+ *     (at least one), where the unit is the L: field or the ABC default
+ *     for the meter; broken rhythm and tuplets change the duration first,
+ *   - letters are upper case with octave and accidental removed.
+ *
+ * Numbers in the notation are read to at most MAX_DIGITS digits, and a
+ * tune is rejected once a note would need more than MAX_COPIES symbols or
+ * its key would pass MAX_KEY_LENGTH, so malformed imports cannot overflow
+ * or exhaust memory.
+ *
+ * Key signatures and accidentals (carried to the end of the bar) are
+ * applied to give every key symbol a MIDI pitch, so indexed tunes can also be
+ * played. Each symbol also records the bar and byte offset of the note it
+ * came from, which maps a match in the key back to the notation.
+ *
+ * One pass over the text and one over the tokens, with no allocation once
+ * the indexer's buffers have grown; keep one indexer per thread.
+ */
+
+#ifndef TUNEPAL_CORE_ABC_INDEXER_H
+#define TUNEPAL_CORE_ABC_INDEXER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+struct AbcIndexedTune {
+    std::string search_key;
+    std::vector<uint8_t> pitches;    // MIDI note of each key symbol
+    std::vector<uint16_t> bars;      // bar of each key symbol, counted in the notation from 1
+    std::vector<uint32_t> offsets;   // byte offset in the notation of each key symbol's note
+    std::string title;               // first T: field
+    std::string meter;               // M: field as written
+    std::string key;                 // K: field as written
+
+    void clear() {
+        search_key.clear();
+        pitches.clear();
+        bars.clear();
+        offsets.clear();
+        title.clear();
+        meter.clear();
+        key.clear();
+    }
+};
+
+class AbcIndexer {
+public:
+    /**
+     * Index one tune
+     * @param abc Notation (header and body)
+     * @param size Length in bytes
+     * @param out Search key, per-symbol pitch/bar/offset and header fields
+     * @return true if the tune had at least one note and stayed within
+     *         the length limits
+     */
+    bool index(const char* abc, size_t size, AbcIndexedTune& out) {
+        out.clear();
+        tokens_.clear();
+        text_ = abc;
+        end_ = abc + size;
+        unit_ = 0.0;
+        default_unit_ = 0.125;
+        base_unit_ = 0.0;
+        set_key("C");
+        reset_bar_accidentals();
+        bar_ = 1;
+        bar_has_notes_ = false;
+        tuplet_left_ = 0;
+        tuplet_ratio_ = 1.0;
+        pending_broken_ = 1.0;
+
+        // Without a K: field there is no header and every line is music
+        if (!scan(out, true)) scan(out, false);
+        if (!expand(out)) {
+            out.clear();
+            return false;
+        }
+        return !out.search_key.empty();
+    }
+
+    static constexpr int MAX_DIGITS = 4;               // further digits of a number are skipped
+    static constexpr long MAX_COPIES = 64;             // key symbols from one note
+    static constexpr size_t MAX_KEY_LENGTH = 65535;
+
+private:
+    /**
+     * Read fields and music line by line
+     * @param header Music starts after the first K: field
+     * @return false if a header never ended
+     */
+    bool scan(AbcIndexedTune& out, bool header) {
+        const char* p = text_;
+        while (p < end_) {
+            const char* line_end = p;
+            while (line_end < end_ && *line_end != '\n' && *line_end != '\r') line_end++;
+            if (is_field_line(p, line_end)) {
+                field(p[0], p + 2, line_end, out);
+                if (p[0] == 'K') header = false;
+            } else if (!header) {
+                music(p, line_end, out);
+            }
+            p = line_end;
+            while (p < end_ && (*p == '\n' || *p == '\r')) p++;
+        }
+        return !header;
+    }
+
+    enum TokenType : uint8_t { NOTE, BAR, SECTION, REPEAT_START, REPEAT_END, REPEAT_BOTH, ENDING };
+
+    struct Token {
+        TokenType type;
+        char letter;        // NOTE: upper-case letter
+        uint8_t pitch;      // NOTE: MIDI note
+        uint16_t bar;
+        uint32_t endings;   // ENDING: bit n set for ending n
+        uint32_t offset;
+        double units;       // NOTE: duration in units of L
+    };
+
+    static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+    // A run of digits, of which only the first MAX_DIGITS count
+    static int number(const char*& p, const char* end) {
+        int value = 0;
+        for (int digits = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (digits < MAX_DIGITS) value = value * 10 + (*p - '0');
+        }
+        return value;
+    }
+
+    static bool is_field_line(const char* p, const char* line_end) {
+        return line_end - p >= 2 && ((p[0] >= 'A' && p[0] <= 'Z') || (p[0] >= 'a' && p[0] <= 'z')) && p[1] == ':';
+    }
+
+    static std::string trimmed(const char* begin, const char* end) {
+        while (begin < end && is_space(*begin)) begin++;
+        while (end > begin && is_space(end[-1])) end--;
+        const char* comment = std::find(begin, end, '%');
+        while (comment > begin && is_space(comment[-1])) comment--;
+        return std::string(begin, comment);
+    }
+
+    double unit() const { return unit_ > 0.0 ? unit_ : default_unit_; }
+
+    // Header or inline field; only the ones that change how notes are read matter
+    void field(char name, const char* begin, const char* end, AbcIndexedTune& out) {
+        std::string value = trimmed(begin, end);
+        switch (name) {
+        case 'T':
+            if (out.title.empty()) out.title = value;
+            break;
+        case 'M':
+            if (out.meter.empty()) out.meter = value;
+            set_meter(value);
+            break;
+        case 'L': {
+            double length = fraction(value);
+            if (length > 0.0) unit_ = length;
+            break;
+        }
+        case 'K':
+            if (out.key.empty()) out.key = value;
+            set_key(value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    static double fraction(const std::string& value) {
+        const char* p = value.data();
+        const char* end = p + value.size();
+        int numerator = number(p, end);
+        int denominator = 1;
+        if (p < end && *p == '/') {
+            p++;
+            denominator = number(p, end);
+        }
+        return numerator > 0 && denominator > 0 ? numerator / static_cast<double>(denominator) : 0.0;
+    }
+
+    // Without L:, meters under 3/4 are written in semiquavers and the rest in quavers
+    void set_meter(const std::string& value) {
+        double meter = 1.0;
+        if (value == "C" || value == "C|") {
+            meter = 1.0;
+        } else if (value != "none" && !value.empty()) {
+            meter = fraction(value);
+            if (meter <= 0.0) meter = 1.0;
+        }
+        default_unit_ = meter < 0.75 ? 0.0625 : 0.125;
+    }
+
+    /**
+     * Key signature from a K: value: tonic, mode and any explicit
+     * accidentals ("D", "Ador", "F#m", "Bb mix", "D exp ^f ^c", "none")
+     */
+    void set_key(const std::string& value) {
+        std::fill(key_accidentals_, key_accidentals_ + 7, 0);
+        size_t i = 0;
+        while (i < value.size() && is_space(value[i])) i++;
+        if (i >= value.size() || value[i] < 'A' || value[i] > 'G') {
+            if (value.compare(i, 2, "Hp") == 0) {
+                key_accidentals_[letter_index('F')] = 1;   // pipes: F and C sharp
+                key_accidentals_[letter_index('C')] = 1;
+            }
+            explicit_accidentals(value, i);
+            reset_bar_accidentals();
+            return;
+        }
+        static const int TONIC_FIFTHS[7] = {3, 5, 0, 2, 4, -1, 1};   // A B C D E F G major
+        int fifths = TONIC_FIFTHS[value[i] - 'A'];
+        i++;
+        if (i < value.size() && value[i] == '#') { fifths += 7; i++; }
+        else if (i < value.size() && value[i] == 'b') { fifths -= 7; i++; }
+        while (i < value.size() && is_space(value[i])) i++;
+
+        std::string mode;
+        while (i < value.size() && mode.size() < 3 && ((value[i] >= 'a' && value[i] <= 'z') || (value[i] >= 'A' && value[i] <= 'Z'))) {
+            mode.push_back(static_cast<char>(value[i] | 0x20));
+            i++;
+        }
+        while (i < value.size() && ((value[i] >= 'a' && value[i] <= 'z') || (value[i] >= 'A' && value[i] <= 'Z'))) i++;
+        if (mode == "m" || mode == "min" || mode == "aeo") fifths -= 3;
+        else if (mode == "mix") fifths -= 1;
+        else if (mode == "dor") fifths -= 2;
+        else if (mode == "phr") fifths -= 4;
+        else if (mode == "loc") fifths -= 5;
+        else if (mode == "lyd") fifths += 1;
+
+        static const char SHARP_ORDER[7] = {'F', 'C', 'G', 'D', 'A', 'E', 'B'};
+        for (int s = 0; s < std::min(fifths, 7); s++) key_accidentals_[letter_index(SHARP_ORDER[s])] = 1;
+        for (int s = 0; s < std::min(-fifths, 7); s++) key_accidentals_[letter_index(SHARP_ORDER[6 - s])] = -1;
+        explicit_accidentals(value, i);
+        reset_bar_accidentals();
+    }
+
+    void explicit_accidentals(const std::string& value, size_t i) {
+        for (; i < value.size(); i++) {
+            int shift = 0;
+            size_t j = i;
+            while (j < value.size() && (value[j] == '^' || value[j] == '_' || value[j] == '=')) {
+                shift += value[j] == '^' ? 1 : value[j] == '_' ? -1 : 0;
+                j++;
+            }
+            if (j > i && j < value.size() && letter_index(value[j]) >= 0) {
+                key_accidentals_[letter_index(value[j])] = shift;
+                i = j;
+            }
+        }
+    }
+
+    // 0-6 for C-B in either case, -1 for anything else
+    static int letter_index(char c) {
+        static const int INDEX[7] = {5, 6, 0, 1, 2, 3, 4};   // A B C D E F G
+        if (c >= 'a' && c <= 'g') return INDEX[c - 'a'];
+        if (c >= 'A' && c <= 'G') return INDEX[c - 'A'];
+        return -1;
+    }
+
+    void reset_bar_accidentals() { std::fill(bar_accidentals_, bar_accidentals_ + sizeof(bar_accidentals_) / sizeof(bar_accidentals_[0]), NO_ACCIDENTAL); }
+
+    void push(TokenType type, const char* at, uint32_t endings = 0) {
+        Token token = {type, 0, 0, bar_, endings, static_cast<uint32_t>(at - text_), 0.0};
+        tokens_.push_back(token);
+    }
+
+    /**
+     * Length multiplier after a note: "2", "3/2", "/", "//", "/4"
+     */
+    static double length(const char*& p, const char* end) {
+        const char* digits = p;
+        int numerator = number(p, end);
+        double value = p > digits ? numerator : 1.0;
+        while (p < end && *p == '/') {
+            p++;
+            digits = p;
+            int denominator = number(p, end);
+            value /= p > digits && denominator > 0 ? denominator : 2;
+        }
+        return value;
+    }
+
+    /**
+     * One note: accidentals, letter, octave marks and length
+     * @param pitch MIDI note, with key signature and bar accidentals applied
+     * @return false if there was no note at p
+     */
+    bool note(const char*& p, const char* end, char& letter, int& pitch, double& units) {
+        const char* q = p;
+        int shift = 0;
+        bool has_accidental = false;
+        while (q < end && (*q == '^' || *q == '_' || *q == '=')) {
+            shift += *q == '^' ? 1 : *q == '_' ? -1 : 0;
+            has_accidental = true;
+            q++;
+        }
+        int index = q < end ? letter_index(*q) : -1;
+        if (index < 0) return false;
+        static const int SEMITONES[7] = {0, 2, 4, 5, 7, 9, 11};
+        int octave = *q >= 'a' ? 5 : 4;
+        letter = static_cast<char>(*q >= 'a' ? *q - 32 : *q);
+        q++;
+        while (q < end && (*q == '\'' || *q == ',')) octave += *q++ == '\'' ? 1 : -1;
+        octave = std::max(0, std::min(octave, 9));
+
+        int slot = octave * 7 + index;
+        if (has_accidental) bar_accidentals_[slot] = static_cast<int8_t>(shift);
+        int accidental = bar_accidentals_[slot] != NO_ACCIDENTAL ? bar_accidentals_[slot] : key_accidentals_[index];
+        pitch = std::max(0, std::min(12 + octave * 12 + SEMITONES[index] + accidental, 127));
+        units = length(q, end);
+        p = q;
+        return true;
+    }
+
+    void add_note(const char* at, char letter, int pitch, double units) {
+        if (base_unit_ == 0.0) base_unit_ = unit();
+        units *= pending_broken_ * unit() / base_unit_;   // a later L: keeps counting in the first unit
+        pending_broken_ = 1.0;
+        if (tuplet_left_ > 0) {
+            units *= tuplet_ratio_;
+            tuplet_left_--;
+        }
+        Token token = {NOTE, letter, static_cast<uint8_t>(pitch), bar_, 0, static_cast<uint32_t>(at - text_), units};
+        tokens_.push_back(token);
+        bar_has_notes_ = true;
+    }
+
+    // Digits after a bar line or "[": "1", "1,3", "1-2"
+    static uint32_t ending_numbers(const char*& p, const char* end) {
+        uint32_t mask = 0;
+        int previous = 0;
+        bool range = false;
+        while (p < end) {
+            if (*p >= '0' && *p <= '9') {
+                int n = number(p, end);
+                int from = range ? previous : n;
+                for (int e = std::max(from, 1); e <= n && e < 32; e++) mask |= uint32_t(1) << e;
+                previous = n;
+                range = false;
+            } else if ((*p == ',' || *p == '-') && p + 1 < end && p[1] >= '0' && p[1] <= '9') {
+                range = *p == '-';
+                p++;
+            } else {
+                break;
+            }
+        }
+        return mask;
+    }
+
+    // A run of bar line characters: | || |] [| |: :| :: :|: with an optional ending number
+    void bar_line(const char*& p, const char* end) {
+        const char* start = p;
+        while (p < end && (*p == '|' || *p == ':' || *p == ']' || (*p == '[' && p + 1 < end && p[1] == '|'))) p++;
+        size_t run = p - start;
+        bool repeat_end = start[0] == ':';
+        bool repeat_start = run > 1 && start[run - 1] == ':';
+        bool section = false;
+        for (size_t i = 0; i + 1 < run; i++) {
+            if ((start[i] == '|' && (start[i + 1] == '|' || start[i + 1] == ']')) || (start[i] == '[' && start[i + 1] == '|')) section = true;
+        }
+
+        if (repeat_end && repeat_start) push(REPEAT_BOTH, start);
+        else if (repeat_end) push(REPEAT_END, start);
+        else if (repeat_start) push(REPEAT_START, start);
+        else if (section) push(SECTION, start);
+        else push(BAR, start);
+
+        // "|1", ":|2" or a bracketed ending after the bar, ":| [2"
+        const char* q = p;
+        while (q < end && is_space(*q)) q++;
+        bool bracket = q + 1 < end && q[0] == '[' && q[1] >= '0' && q[1] <= '9';
+        if (bracket) q++;
+        if ((bracket || q == p) && q < end && *q >= '0' && *q <= '9') {
+            uint32_t mask = ending_numbers(q, end);
+            if (mask) push(ENDING, start, mask);
+            p = q;
+        }
+        if (bar_has_notes_) bar_++;
+        bar_has_notes_ = false;
+        reset_bar_accidentals();
+    }
+
+    // Tokens of one line of the tune body
+    void music(const char* p, const char* end, AbcIndexedTune& out) {
+        while (p < end) {
+            char c = *p;
+            if (c == '%') return;
+            char letter;
+            int pitch;
+            double units;
+            const char* at = p;
+            if (note(p, end, letter, pitch, units)) {
+                add_note(at, letter, pitch, units);
+            } else if (c == '|' || (c == ':' && p + 1 < end && (p[1] == '|' || p[1] == ':'))) {
+                bar_line(p, end);
+            } else if (c == '[') {
+                if (p + 1 < end && p[1] == '|') {
+                    bar_line(p, end);
+                } else if (p + 1 < end && p[1] >= '0' && p[1] <= '9') {
+                    p++;
+                    uint32_t mask = ending_numbers(p, end);
+                    if (mask) push(ENDING, at, mask);
+                } else if (p + 2 < end && p[2] == ':' && ((p[1] >= 'A' && p[1] <= 'Z') || (p[1] >= 'a' && p[1] <= 'z'))) {
+                    const char* close = std::find(p, end, ']');   // inline field, [K:G]
+                    field(p[1], p + 3, close, out);
+                    p = close < end ? close + 1 : end;
+                } else {
+                    chord(p, end);
+                }
+            } else if (c == '{') {
+                const char* close = std::find(p, end, '}');   // grace notes
+                p = close < end ? close + 1 : end;
+            } else if (c == '"') {
+                const char* close = std::find(p + 1, end, '"');   // chord symbol or annotation
+                p = close < end ? close + 1 : end;
+            } else if (c == '!' || c == '+') {
+                const char* close = std::find(p + 1, end, c);   // !trill! +fermata+
+                p = close < end ? close + 1 : p + 1;
+            } else if (c == 'z' || c == 'x' || c == 'Z' || c == 'X') {
+                p++;
+                length(p, end);   // rests are not part of the key
+                pending_broken_ = 1.0;
+            } else if (c == '(' && p + 1 < end && p[1] >= '2' && p[1] <= '9') {
+                tuplet(p, end);
+            } else if (c == '>' || c == '<') {
+                int dots = 0;
+                while (p < end && *p == c) { dots++; p++; }
+                double shorter = std::pow(0.5, dots);
+                if (!tokens_.empty() && tokens_.back().type == NOTE) tokens_.back().units *= c == '>' ? 2.0 - shorter : shorter;
+                pending_broken_ = c == '>' ? shorter : 2.0 - shorter;
+            } else {
+                p++;   // ties, slurs, spaces, decorations (~ . H-W h-w), spacers, overlays
+            }
+        }
+    }
+
+    // [CEG]2: the highest note, lengthened by the chord's multiplier
+    void chord(const char*& p, const char* end) {
+        const char* at = p;
+        p++;
+        char best_letter = 0;
+        int best_pitch = -1;
+        double best_units = 1.0;
+        while (p < end && *p != ']') {
+            char letter;
+            int pitch;
+            double units;
+            if (note(p, end, letter, pitch, units)) {
+                if (pitch > best_pitch) {
+                    best_letter = letter;
+                    best_pitch = pitch;
+                    best_units = units;
+                }
+            } else {
+                p++;
+            }
+        }
+        if (p < end) p++;
+        double multiplier = length(p, end);
+        if (best_pitch >= 0) add_note(at, best_letter, best_pitch, best_units * multiplier);
+    }
+
+    // (p:q:r puts p notes in the time of q for the next r notes
+    void tuplet(const char*& p, const char* end) {
+        p++;
+        int counts[3] = {0, 0, 0};
+        int field = 0;
+        while (p < end && field < 3) {
+            if (*p >= '0' && *p <= '9') {
+                counts[field] = number(p, end);
+            } else if (*p == ':') {
+                field++;
+                p++;
+            } else {
+                break;
+            }
+        }
+        int notes = counts[0];
+        int time = counts[1];
+        if (time <= 0) time = (notes == 3 || notes == 6) ? 2 : (notes == 2 || notes == 4 || notes == 8) ? 3 : 2;
+        tuplet_ratio_ = notes > 0 ? time / static_cast<double>(notes) : 1.0;
+        tuplet_left_ = counts[2] > 0 ? counts[2] : notes;
+    }
+
+    /**
+     * Play the tokens out: a repeat end jumps back once to the last start,
+     * and notes under an ending are only kept on the pass it names
+     * @return false if the key outgrew the length limits
+     */
+    bool expand(AbcIndexedTune& out) {
+        done_.assign(tokens_.size(), 0);
+        size_t start = 0;
+        int pass = 1;
+        uint32_t ending = 0;
+        size_t t = 0;
+        while (t < tokens_.size()) {
+            const Token& token = tokens_[t];
+            switch (token.type) {
+            case NOTE:
+                if (ending == 0 || (pass < 32 && (ending >> pass & 1))) {
+                    if (!emit(token, out)) return false;
+                }
+                break;
+            case ENDING:
+                ending = token.endings;
+                break;
+            case BAR:
+                break;
+            case SECTION:
+            case REPEAT_START:
+                start = t + 1;
+                pass = 1;
+                ending = 0;
+                break;
+            case REPEAT_END:
+            case REPEAT_BOTH:
+                if (!done_[t]) {
+                    done_[t] = 1;
+                    pass++;
+                    ending = 0;
+                    t = start;
+                    continue;
+                }
+                // Second time through: an ending right after keeps this pass
+                start = t + 1;
+                ending = 0;
+                if (token.type == REPEAT_BOTH || t + 1 >= tokens_.size() || tokens_[t + 1].type != ENDING) pass = 1;
+                break;
+            }
+            t++;
+        }
+        return true;
+    }
+
+    bool emit(const Token& token, AbcIndexedTune& out) {
+        double units = std::round(token.units);
+        if (!(units <= MAX_COPIES) || out.search_key.size() + static_cast<size_t>(std::max(units, 1.0)) > MAX_KEY_LENGTH) return false;
+        long copies = std::max(1L, static_cast<long>(units));
+        for (long i = 0; i < copies; i++) {
+            out.search_key.push_back(token.letter);
+            out.pitches.push_back(token.pitch);
+            out.bars.push_back(token.bar);
+            out.offsets.push_back(token.offset);
+        }
+        return true;
+    }
+
+    static constexpr int8_t NO_ACCIDENTAL = -128;
+
+    std::vector<Token> tokens_;
+    std::vector<uint8_t> done_;
+    const char* text_ = nullptr;
+    const char* end_ = nullptr;
+    double unit_ = 0.0;             // from L:, 0 until set
+    double default_unit_ = 0.125;   // from M:
+    double base_unit_ = 0.0;        // unit of the first note; key symbols are counted in it
+    int key_accidentals_[7];        // semitones per letter, C-B
+    int8_t bar_accidentals_[70];    // per octave and letter until the bar line
+    uint16_t bar_ = 1;
+    bool bar_has_notes_ = false;
+    int tuplet_left_ = 0;
+    double tuplet_ratio_ = 1.0;
+    double pending_broken_ = 1.0;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_ABC_INDEXER_H
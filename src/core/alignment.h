@@ -0,0 +1,298 @@
+/**
+ * Semi-Global Alignment Engine
+ *
+ * The single DP loop behind every matcher. Tunepal::edSubstring,
+ * TunepalExperimental::needleman_wunsch, DtwMatcher::subsequence_match and
+ * the match traceback (core/traceback.h) are instantiations of Aligner that
+ * differ only in their compile-time policies:
+ *
+ *   Cost      Cell type, substitution cost, and how a cell combines its
+ *             diagonal, upper and left neighbours.
+ *   Boundary  Values of the first row and first column, and which cells of
+ *             the last row may end an alignment.
+ *   Cell      Storage type of a DP row (e.g. uint16_t for rows kept in the
+ *             query cache); arithmetic is always done in Cost::Cell.
+ *
+ * The DP is kept as a single row updated in place, so callers can stop after
+ * any pattern prefix and resume later. An optimization added here (early
+ * exit, banding, vectorization) is compiled into every matcher.
+ */
+
+#ifndef TUNEPAL_CORE_ALIGNMENT_H
+#define TUNEPAL_CORE_ALIGNMENT_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "scratch_arena.h"
+
+namespace tunepal {
+
+// ========================================
+// Cost policies
+// ========================================
+
+// Unit-cost Levenshtein: insertion, deletion and substitution all cost 1
+struct UnitEditCost {
+    typedef int Cell;
+
+    template <typename P, typename T>
+    static Cell substitution(P p, T t) {
+        return t != static_cast<T>(p) ? 1 : 0;
+    }
+
+    static Cell combine(Cell diag, Cell up, Cell left, Cell sub) {
+        return std::min(std::min(up + 1, left + 1), diag + sub);
+    }
+};
+
+// Unit-cost Levenshtein where 'Z' in the pattern matches any note (edSubstring)
+struct WildcardEditCost : UnitEditCost {
+    template <typename P, typename T>
+    static Cell substitution(P p, T t) {
+        return (t != static_cast<T>(p) && p != 'Z') ? 1 : 0;
+    }
+};
+
+// DTW over pitch values: every cell pays |p - t| plus its cheapest neighbour
+struct AbsoluteDifferenceCost {
+    typedef float Cell;
+
+    static Cell substitution(float p, float t) {
+        return std::abs(p - t);
+    }
+
+    static Cell combine(Cell diag, Cell up, Cell left, Cell sub) {
+        return sub + std::min({diag, up, left});
+    }
+};
+
+// ========================================
+// Boundary policies
+// ========================================
+
+// The pattern may start and end anywhere in the text; unmatched pattern
+// notes cost one each (first column 0, 1, 2, ...)
+struct SubstringBoundary {
+    template <typename Score>
+    static Score top(int) { return Score(0); }
+
+    template <typename Score>
+    static Score left(int row) { return Score(row); }
+
+    static constexpr int first_end_column(int) { return 0; }
+};
+
+// Subsequence DTW: free start in the text, but every pattern note must be
+// aligned to at least one text note (first column is unreachable)
+struct SubsequenceBoundary {
+    template <typename Score>
+    static Score top(int) { return Score(0); }
+
+    template <typename Score>
+    static Score left(int) { return std::numeric_limits<Score>::infinity(); }
+
+    static constexpr int first_end_column(int) { return 1; }
+};
+
+// Whole pattern against whole text: skipped text notes cost one each too
+// (first row 0, 1, 2, ...), and only the last column ends an alignment
+struct GlobalBoundary {
+    template <typename Score>
+    static Score top(int column) { return Score(column); }
+
+    template <typename Score>
+    static Score left(int row) { return Score(row); }
+
+    static constexpr int first_end_column(int text_length) { return text_length; }
+};
+
+// ========================================
+// Engine
+// ========================================
+
+template <typename Cost, typename Boundary, typename Cell = typename Cost::Cell>
+struct Aligner {
+    typedef typename Cost::Cell Score;
+
+    /**
+     * Reset a row to the empty-pattern state
+     * @param row Row of text_length + 1 cells
+     */
+    static void init_row(Cell* row, int text_length) {
+        for (int j = 0; j <= text_length; j++) {
+            row[j] = static_cast<Cell>(Boundary::template top<Score>(j));
+        }
+    }
+
+    /**
+     * Advance a row by several pattern symbols
+     * @param row Row after the first `rows_done` pattern symbols, updated in place
+     * @param rows_done Number of pattern symbols already applied to `row`
+     * @param pattern Symbols to apply next
+     * @param count Number of symbols in `pattern`
+     * @param text Text being searched
+     * @param text_length Length of `text`
+     */
+    template <typename P, typename T>
+    static void advance(Cell* row, int rows_done, const P* pattern, int count,
+                        const T* text, int text_length) {
+        for (int p = 0; p < count; p++) {
+            advance_one<false>(row, rows_done + p + 1, pattern[p], text, text_length);
+        }
+    }
+
+    /**
+     * Advance like advance(), but give up as soon as a whole row exceeds
+     * `cutoff`. Rows never decrease, so the final score could then only be
+     * worse than the cutoff.
+     * @return false if the alignment was abandoned (the row is then only a bound)
+     */
+    template <typename P, typename T>
+    static bool advance_bounded(Cell* row, int rows_done, const P* pattern, int count,
+                                const T* text, int text_length, Score cutoff) {
+        for (int p = 0; p < count; p++) {
+            if (advance_one<true>(row, rows_done + p + 1, pattern[p], text, text_length) > cutoff) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Best alignment score for a finished row
+     */
+    static Score finish(const Cell* row, int text_length) {
+        int first = Boundary::first_end_column(text_length);
+        Score best = static_cast<Score>(row[first]);
+        for (int j = first + 1; j <= text_length; j++) {
+            best = std::min(best, static_cast<Score>(row[j]));
+        }
+        return best;
+    }
+
+    /**
+     * Align a whole pattern, with the row drawn from the thread's scratch arena
+     */
+    template <typename P, typename T>
+    static Score align(const P* pattern, int pattern_length, const T* text, int text_length) {
+        ScratchArena& arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        Cell* row = arena.alloc<Cell>(text_length + 1);
+        init_row(row, text_length);
+        advance(row, 0, pattern, pattern_length, text, text_length);
+        return finish(row, text_length);
+    }
+
+private:
+    // Computes one row; returns its smallest cell when TrackMin is set
+    template <bool TrackMin, typename P, typename T>
+    static Score advance_one(Cell* row, int row_index, P symbol, const T* text, int text_length) {
+        Score diag = static_cast<Score>(row[0]);
+        Score left = Boundary::template left<Score>(row_index);
+        Score row_min = left;
+        row[0] = static_cast<Cell>(left);
+
+        for (int j = 1; j <= text_length; j++) {
+            Score up = static_cast<Score>(row[j]);
+            Score value = Cost::combine(diag, up, left, Cost::substitution(symbol, text[j - 1]));
+            row[j] = static_cast<Cell>(value);
+            if (TrackMin) row_min = std::min(row_min, value);
+            diag = up;
+            left = value;
+        }
+        return row_min;
+    }
+};
+
+// ========================================
+// Banded engine
+// ========================================
+
+/**
+ * Alignment restricted to a band around one diagonal: row i only computes
+ * columns i + diagonal - band .. i + diagonal + band, and everything outside
+ * is unreachable. The result is never better than Aligner::align and equals
+ * it whenever the best alignment stays inside the band, at O(m * band)
+ * instead of O(m * n). Used to verify seed hits (see core/fm_index.h).
+ */
+template <typename Cost, typename Boundary>
+struct BandedAligner {
+    typedef typename Cost::Cell Score;
+
+    static Score unreachable() {
+        return std::numeric_limits<Score>::has_infinity ? std::numeric_limits<Score>::infinity()
+                                                        : std::numeric_limits<Score>::max() / 2;
+    }
+
+    /**
+     * @param diagonal Text column aligned with the first pattern symbol
+     * @param band Columns allowed on either side of the diagonal
+     */
+    template <typename P, typename T>
+    static Score align(const P* pattern, int pattern_length, const T* text, int text_length,
+                       int diagonal, int band) {
+        const Score inf = unreachable();
+        int width = 2 * band + 1;
+        ScratchArena& arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        // Cell o of row i holds column i + first + o; one spare cell on the right
+        Score* row = arena.alloc<Score>(width + 1);
+        int first = diagonal - band;
+
+        for (int o = 0; o < width; o++) {
+            int j = first + o;
+            row[o] = (j >= 0 && j <= text_length) ? Boundary::template top<Score>(j) : inf;
+        }
+        row[width] = inf;
+
+        for (int i = 1; i <= pattern_length; i++) {
+            Score left = inf;
+            for (int o = 0; o < width; o++) {
+                int j = i + first + o;
+                Score value;
+                if (j < 0 || j > text_length) {
+                    value = inf;
+                } else if (j == 0) {
+                    value = Boundary::template left<Score>(i);
+                } else {
+                    // Same cell index is (i-1, j-1), the next one is (i-1, j)
+                    value = Cost::combine(row[o], row[o + 1], left,
+                                          Cost::substitution(pattern[i - 1], text[j - 1]));
+                    if (value > inf) value = inf;
+                }
+                row[o] = value;
+                left = value;
+            }
+        }
+
+        Score best = inf;
+        for (int o = 0; o < width; o++) {
+            int j = pattern_length + first + o;
+            if (j >= Boundary::first_end_column(text_length) && j <= text_length) best = std::min(best, row[o]);
+        }
+        return best;
+    }
+};
+
+// ========================================
+// The matchers
+// ========================================
+
+// Tunepal::edSubstring
+template <typename Cell = int>
+using EdSubstringAligner = Aligner<WildcardEditCost, SubstringBoundary, Cell>;
+
+// TunepalExperimental::needleman_wunsch
+typedef Aligner<UnitEditCost, SubstringBoundary> EditDistanceAligner;
+
+// DtwMatcher::subsequence_match
+typedef Aligner<AbsoluteDifferenceCost, SubsequenceBoundary> SubsequenceDtwAligner;
+
+// Seed verification for Tunepal's FM-index search
+typedef BandedAligner<WildcardEditCost, SubstringBoundary> BandedEdSubstringAligner;
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_ALIGNMENT_H
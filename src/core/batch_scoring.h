@@ -0,0 +1,153 @@
+/**
+ * Multi-Query Batch Scoring
+ *
+ * Scores many queries against the same set of texts. Scoring queries one at
+ * a time streams every text through the cache once per query; here the texts
+ * are cut into blocks small enough to stay in L2 (keys plus their DP rows),
+ * and each block is scored against every query before moving on. Blocks are
+ * spread over the worker pool, every worker keeps its own top-k per query,
+ * and the heaps are merged at the end. The current k-th best score is handed
+ * to the scorer as a cutoff so it can abandon hopeless alignments early.
+ */
+
+#ifndef TUNEPAL_CORE_BATCH_SCORING_H
+#define TUNEPAL_CORE_BATCH_SCORING_H
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunepal {
+
+template <typename Score>
+struct BatchHit {
+    uint32_t index;
+    Score score;
+};
+
+/**
+ * Bounded set of the k best hits. Ties are broken by the lower index, so the
+ * result does not depend on the order hits were offered in.
+ */
+template <typename Score>
+class TopK {
+public:
+    TopK(size_t k = 0, bool lower_is_better = true) : k_(k), lower_is_better_(lower_is_better) {
+        hits_.reserve(k);
+    }
+
+    bool full() const { return k_ > 0 && hits_.size() == k_; }
+
+    // The hit a newcomer has to beat; only meaningful when full()
+    Score worst() const { return hits_.front().score; }
+
+    void offer(uint32_t index, Score score) {
+        if (k_ == 0) return;
+        BatchHit<Score> hit = {index, score};
+        Before before(lower_is_better_);
+        if (hits_.size() < k_) {
+            hits_.push_back(hit);
+            std::push_heap(hits_.begin(), hits_.end(), before);
+        } else if (before(hit, hits_.front())) {
+            std::pop_heap(hits_.begin(), hits_.end(), before);
+            hits_.back() = hit;
+            std::push_heap(hits_.begin(), hits_.end(), before);
+        }
+    }
+
+    void merge(const TopK& other) {
+        for (size_t i = 0; i < other.hits_.size(); i++) offer(other.hits_[i].index, other.hits_[i].score);
+    }
+
+    // Best first
+    std::vector<BatchHit<Score>> sorted() const {
+        std::vector<BatchHit<Score>> result = hits_;
+        std::sort(result.begin(), result.end(), Before(lower_is_better_));
+        return result;
+    }
+
+private:
+    // a ranks ahead of b; as a heap comparator it keeps the worst hit on top
+    struct Before {
+        bool lower_is_better;
+        explicit Before(bool lower) : lower_is_better(lower) {}
+        bool operator()(const BatchHit<Score>& a, const BatchHit<Score>& b) const {
+            if (a.score != b.score) return lower_is_better ? a.score < b.score : a.score > b.score;
+            return a.index < b.index;
+        }
+    };
+
+    size_t k_;
+    bool lower_is_better_;
+    std::vector<BatchHit<Score>> hits_;
+};
+
+// Target footprint of one block of texts, sized to sit in L2 with its DP rows
+const size_t BATCH_BLOCK_BYTES = 64 * 1024;
+
+/**
+ * Score every query against every text and keep each query's k best
+ * @param query_count Number of queries
+ * @param text_count Number of texts
+ * @param k Hits to keep per query
+ * @param lower_is_better true for distances, false for similarities
+ * @param text_bytes text_bytes(t): bytes touched when scoring text t
+ * @param score score(q, t, cutoff, out): stores the score of query q against
+ *        text t in out and returns true, or returns false once it is certain
+ *        the score cannot beat *cutoff. cutoff is null until the query has k hits.
+ * @param text_ids Optional id reported for each text (ties go to the lower
+ *        id); by default the text's position
+ * @param block_bytes Block size target
+ * @return Per query, its hits best first
+ */
+template <typename Score, typename TextBytes, typename ScoreFn>
+std::vector<std::vector<BatchHit<Score>>> score_batch(size_t query_count, size_t text_count, size_t k,
+        bool lower_is_better, TextBytes text_bytes, ScoreFn score, const uint32_t* text_ids = nullptr,
+        size_t block_bytes = BATCH_BLOCK_BYTES) {
+    std::vector<size_t> block_starts;
+    size_t bytes = block_bytes;
+    for (size_t t = 0; t < text_count; t++) {
+        if (bytes >= block_bytes) {
+            block_starts.push_back(t);
+            bytes = 0;
+        }
+        bytes += text_bytes(t);
+    }
+    block_starts.push_back(text_count);
+    size_t block_count = block_starts.size() - 1;
+
+    // One heap per query per worker, so blocks never contend
+    size_t workers = static_cast<size_t>(worker_count());
+    std::vector<TopK<Score>> heaps(workers * query_count, TopK<Score>(k, lower_is_better));
+
+    parallel_for(block_count, 1, [&](size_t begin, size_t end, int worker) {
+        TopK<Score>* local = heaps.data() + static_cast<size_t>(worker) * query_count;
+        for (size_t b = begin; b < end; b++) {
+            for (size_t q = 0; q < query_count; q++) {
+                TopK<Score>& top = local[q];
+                for (size_t t = block_starts[b]; t < block_starts[b + 1]; t++) {
+                    Score cutoff = top.full() ? top.worst() : Score();
+                    Score value;
+                    if (score(q, t, top.full() ? &cutoff : nullptr, value)) {
+                        top.offer(text_ids ? text_ids[t] : static_cast<uint32_t>(t), value);
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<std::vector<BatchHit<Score>>> results(query_count);
+    for (size_t q = 0; q < query_count; q++) {
+        TopK<Score>& merged = heaps[q];
+        for (size_t w = 1; w < workers; w++) merged.merge(heaps[w * query_count + q]);
+        results[q] = merged.sorted();
+    }
+    return results;
+}
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_BATCH_SCORING_H
@@ -0,0 +1,97 @@
+/**
+ * Native Tune Corpus
+ *
+ * Resident copy of the tune search keys, so a search does not have to
+ * round-trip every search_key through GDScript. Keys are stored back-to-back
+ * in a single buffer; each entry keeps its tune id and an interned time
+ * signature that searches can filter on.
+ *
+ * Header-only and free of Godot types so both extensions can share it.
+ */
+
+#ifndef TUNEPAL_CORE_CORPUS_H
+#define TUNEPAL_CORE_CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+class Corpus {
+public:
+    void clear() {
+        data_.clear();
+        offsets_.clear();
+        lengths_.clear();
+        ids_.clear();
+        time_sig_ids_.clear();
+        time_sigs_.clear();
+        generation_++;
+        epoch_++;
+    }
+
+    /**
+     * Append a tune
+     * @param id Tune id (tuneindex.id)
+     * @param key search_key as stored in the database
+     * @param time_sig Time signature, used by search filters
+     * @return Index of the new entry
+     */
+    int add(int64_t id, const std::string& key, const std::string& time_sig) {
+        offsets_.push_back(static_cast<uint32_t>(data_.size()));
+        lengths_.push_back(static_cast<uint32_t>(key.size()));
+        data_.append(key);
+        ids_.push_back(id);
+        time_sig_ids_.push_back(intern_time_sig(time_sig));
+        generation_++;
+        return static_cast<int>(ids_.size()) - 1;
+    }
+
+    size_t size() const { return ids_.size(); }
+    int64_t id(size_t index) const { return ids_[index]; }
+    const char* key(size_t index) const { return data_.data() + offsets_[index]; }
+    int key_length(size_t index) const { return static_cast<int>(lengths_[index]); }
+    size_t key_bytes() const { return data_.size(); }
+
+    int time_sig_id(size_t index) const { return time_sig_ids_[index]; }
+    const std::string& time_sig(size_t index) const { return time_sigs_[time_sig_ids_[index]]; }
+
+    /**
+     * Look up an interned time signature
+     * @return Its id, or -1 if no tune in the corpus uses it
+     */
+    int find_time_sig(const std::string& time_sig) const {
+        for (size_t i = 0; i < time_sigs_.size(); i++) {
+            if (time_sigs_[i] == time_sig) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Bumped on every mutation; caches key on it so stale results are never served
+    uint64_t generation() const { return generation_; }
+
+    // Bumped only by clear(): within one epoch entries are only ever appended
+    uint64_t epoch() const { return epoch_; }
+
+private:
+    int intern_time_sig(const std::string& time_sig) {
+        int found = find_time_sig(time_sig);
+        if (found >= 0) return found;
+        time_sigs_.push_back(time_sig);
+        return static_cast<int>(time_sigs_.size()) - 1;
+    }
+
+    std::string data_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<int64_t> ids_;
+    std::vector<int> time_sig_ids_;
+    std::vector<std::string> time_sigs_;
+    uint64_t generation_ = 0;
+    uint64_t epoch_ = 0;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_CORPUS_H
@@ -0,0 +1,171 @@
+/**
+ * Melodic Feature Index
+ *
+ * Coarse ranking for search. Every search key is summarized as a fixed-size
+ * vector:
+ *   - note histogram (A-G),
+ *   - interval histogram (steps between successive different letters), and
+ *   - hashed trigram counts over the letters with repeats collapsed, so a
+ *     held note and its repeats count once.
+ * Each section is normalized and weighted, the whole vector scaled to unit
+ * length and quantized to int8, and the rows stored back-to-back in one
+ * matrix. Ranking a query is a dot product against every row (SSE2 or NEON
+ * where available), which is cheap enough to run before the exact matcher and
+ * keep only the best few hundred tunes for it.
+ */
+
+#ifndef TUNEPAL_CORE_FEATURE_INDEX_H
+#define TUNEPAL_CORE_FEATURE_INDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TUNEPAL_FEATURES_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TUNEPAL_FEATURES_NEON 1
+#endif
+
+namespace tunepal {
+
+class FeatureIndex {
+public:
+    static const int NOTE_BINS = 7;
+    static const int INTERVAL_BINS = 7;
+    static const int NGRAM_BINS = 114;
+    static const int DIMENSIONS = NOTE_BINS + INTERVAL_BINS + NGRAM_BINS;   // multiple of 16
+
+    void clear() { rows_.clear(); }
+
+    /**
+     * Append the features of a search key
+     * @return Row index (matches the corpus index when added in step)
+     */
+    size_t add(const char* key, int length) {
+        size_t row = size();
+        rows_.resize(rows_.size() + DIMENSIONS);
+        extract(key, length, rows_.data() + row * DIMENSIONS);
+        return row;
+    }
+
+    size_t size() const { return rows_.size() / DIMENSIONS; }
+    const int8_t* row(size_t index) const { return rows_.data() + index * DIMENSIONS; }
+
+    /**
+     * Quantized feature vector of a key or query
+     * @param out DIMENSIONS values
+     */
+    static void extract(const char* key, int length, int8_t* out) {
+        float features[DIMENSIONS] = {0.0f};
+        float* notes = features;
+        float* intervals = features + NOTE_BINS;
+        float* ngrams = features + NOTE_BINS + INTERVAL_BINS;
+
+        int previous[2] = {-1, -1};
+        for (int i = 0; i < length; i++) {
+            int letter = letter_index(key[i]);
+            if (letter < 0) continue;
+            notes[letter] += 1.0f;
+            if (letter == previous[0]) continue;   // repeats are duration, not melody
+
+            if (previous[0] >= 0) {
+                intervals[(letter - previous[0] + NOTE_BINS) % NOTE_BINS] += 1.0f;
+                if (previous[1] >= 0) {
+                    uint32_t code = static_cast<uint32_t>(previous[1] * 49 + previous[0] * 7 + letter);
+                    ngrams[(code * 2654435761u >> 8) % NGRAM_BINS] += 1.0f;
+                }
+            }
+            previous[1] = previous[0];
+            previous[0] = letter;
+        }
+
+        normalize(notes, NOTE_BINS, NOTE_WEIGHT);
+        normalize(intervals, INTERVAL_BINS, INTERVAL_WEIGHT);
+        normalize(ngrams, NGRAM_BINS, NGRAM_WEIGHT);
+        normalize(features, DIMENSIONS, 1.0f);
+        for (int d = 0; d < DIMENSIONS; d++) {
+            out[d] = static_cast<int8_t>(std::lround(features[d] * 127.0f));
+        }
+    }
+
+    /**
+     * Similarity of two quantized vectors (scaled cosine, up to 127 * 127)
+     */
+    static int32_t dot(const int8_t* a, const int8_t* b) {
+#if defined(TUNEPAL_FEATURES_SSE2)
+        __m128i sum = _mm_setzero_si128();
+        for (int d = 0; d < DIMENSIONS; d += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + d));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + d));
+            // Sign-extend to 16 bits, then multiply and add pairs into 32 bits
+            __m128i sa = _mm_cmpgt_epi8(_mm_setzero_si128(), va);
+            __m128i sb = _mm_cmpgt_epi8(_mm_setzero_si128(), vb);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(va, sa), _mm_unpacklo_epi8(vb, sb)));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(va, sa), _mm_unpackhi_epi8(vb, sb)));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+#elif defined(TUNEPAL_FEATURES_NEON)
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int d = 0; d < DIMENSIONS; d += 16) {
+            int8x16_t va = vld1q_s8(a + d);
+            int8x16_t vb = vld1q_s8(b + d);
+            sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+            sum = vpadalq_s16(sum, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+        }
+        return vgetq_lane_s32(sum, 0) + vgetq_lane_s32(sum, 1) + vgetq_lane_s32(sum, 2) + vgetq_lane_s32(sum, 3);
+#else
+        int32_t sum = 0;
+        for (int d = 0; d < DIMENSIONS; d++) sum += static_cast<int32_t>(a[d]) * b[d];
+        return sum;
+#endif
+    }
+
+    /**
+     * Keep the `keep` rows of `candidates` most similar to the query, in
+     * ascending row order. Ties go to the lower row.
+     */
+    void select(const int8_t* query, std::vector<uint32_t>& candidates, size_t keep) const {
+        if (candidates.size() <= keep) return;
+        std::vector<std::pair<int32_t, uint32_t>> scored(candidates.size());
+        for (size_t c = 0; c < candidates.size(); c++) {
+            // Negated so the best sort first
+            scored[c] = std::make_pair(-dot(query, row(candidates[c])), candidates[c]);
+        }
+        std::nth_element(scored.begin(), scored.begin() + keep, scored.end());
+        candidates.resize(keep);
+        for (size_t c = 0; c < keep; c++) candidates[c] = scored[c].second;
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+private:
+    static constexpr float NOTE_WEIGHT = 0.5f;
+    static constexpr float INTERVAL_WEIGHT = 0.5f;
+    static constexpr float NGRAM_WEIGHT = 1.0f;
+
+    static int letter_index(char c) {
+        if (c >= 'a' && c <= 'g') return c - 'a';
+        if (c >= 'A' && c <= 'G') return c - 'A';
+        return -1;
+    }
+
+    static void normalize(float* values, int count, float weight) {
+        float norm = 0.0f;
+        for (int i = 0; i < count; i++) norm += values[i] * values[i];
+        if (norm <= 0.0f) return;
+        float scale = weight / std::sqrt(norm);
+        for (int i = 0; i < count; i++) values[i] *= scale;
+    }
+
+    std::vector<int8_t> rows_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_FEATURE_INDEX_H
@@ -0,0 +1,94 @@
+/**
+ * Radix-2 FFT
+ *
+ * Small iterative complex FFT for the note segmenter. Twiddles and the
+ * bit-reversal permutation are computed once per size, so analysing a frame
+ * does not allocate.
+ */
+
+#ifndef TUNEPAL_CORE_FFT_H
+#define TUNEPAL_CORE_FFT_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace tunepal {
+
+class Fft {
+public:
+    /**
+     * @param size Transform size, must be a power of two
+     */
+    explicit Fft(size_t size = 0) { resize(size); }
+
+    void resize(size_t size) {
+        size_ = size;
+        cos_.resize(size / 2);
+        sin_.resize(size / 2);
+        for (size_t i = 0; i < size / 2; i++) {
+            double angle = -2.0 * PI * static_cast<double>(i) / static_cast<double>(size);
+            cos_[i] = static_cast<float>(std::cos(angle));
+            sin_[i] = static_cast<float>(std::sin(angle));
+        }
+
+        reversed_.resize(size);
+        size_t bits = 0;
+        while ((static_cast<size_t>(1) << bits) < size) bits++;
+        for (size_t i = 0; i < size; i++) {
+            size_t r = 0;
+            for (size_t b = 0; b < bits; b++) {
+                if (i & (static_cast<size_t>(1) << b)) r |= static_cast<size_t>(1) << (bits - 1 - b);
+            }
+            reversed_[i] = r;
+        }
+    }
+
+    size_t size() const { return size_; }
+
+    /**
+     * In-place forward transform
+     * @param re Real parts, size() values
+     * @param im Imaginary parts, size() values
+     */
+    void forward(float* re, float* im) const {
+        for (size_t i = 0; i < size_; i++) {
+            size_t r = reversed_[i];
+            if (r > i) {
+                float t = re[i]; re[i] = re[r]; re[r] = t;
+                t = im[i]; im[i] = im[r]; im[r] = t;
+            }
+        }
+
+        for (size_t len = 2; len <= size_; len <<= 1) {
+            size_t half = len / 2;
+            size_t step = size_ / len;
+            for (size_t start = 0; start < size_; start += len) {
+                for (size_t k = 0; k < half; k++) {
+                    float wr = cos_[k * step];
+                    float wi = sin_[k * step];
+                    size_t a = start + k;
+                    size_t b = a + half;
+                    float tr = re[b] * wr - im[b] * wi;
+                    float ti = re[b] * wi + im[b] * wr;
+                    re[b] = re[a] - tr;
+                    im[b] = im[a] - ti;
+                    re[a] += tr;
+                    im[a] += ti;
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr double PI = 3.14159265358979323846;
+
+    size_t size_ = 0;
+    std::vector<float> cos_;
+    std::vector<float> sin_;
+    std::vector<size_t> reversed_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_FFT_H
@@ -0,0 +1,243 @@
+/**
+ * FM-Index over the Search Keys
+ *
+ * All keys are concatenated (with a separator between them) and indexed as a
+ * Burrows-Wheeler transform with occurrence checkpoints and a sampled suffix
+ * array. Backward search finds every exact occurrence of a short seed in time
+ * proportional to the seed length, independent of the corpus size, which
+ * lets search verify only the few diagonals where a query shares seeds with a
+ * tune instead of aligning against every key (seed and extend).
+ *
+ * Memory is about two bytes per key symbol once built; construction needs
+ * around sixteen bytes per symbol of temporary space. The index is static:
+ * keys appended to the corpus after a build are not in it (see key_count),
+ * so callers scan those directly until a rebuild is worth it.
+ */
+
+#ifndef TUNEPAL_CORE_FM_INDEX_H
+#define TUNEPAL_CORE_FM_INDEX_H
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunepal {
+
+class FmIndex {
+public:
+    // 0 ends the text, 1 separates keys, 2-8 are A-G, 9 is anything else
+    static const int SYMBOLS = 10;
+
+    void clear() {
+        bwt_.clear();
+        occ_.clear();
+        samples_.clear();
+        sampled_.clear();
+        sampled_rank_.clear();
+        key_starts_.clear();
+        std::fill(count_, count_ + SYMBOLS + 1, 0u);
+        epoch_ = 0;
+    }
+
+    bool empty() const { return bwt_.empty(); }
+    size_t size() const { return bwt_.size(); }
+    // Corpus entries [0, key_count()) are indexed
+    size_t key_count() const { return key_starts_.size(); }
+
+    // Corpus epoch the index was built in; entries appended since keep it valid
+    uint64_t epoch() const { return epoch_; }
+
+    size_t memory_bytes() const {
+        return bwt_.size() + occ_.size() * sizeof(uint32_t) + samples_.size() * sizeof(uint32_t)
+                + sampled_.size() * sizeof(uint64_t) + sampled_rank_.size() * sizeof(uint32_t)
+                + key_starts_.size() * sizeof(uint32_t);
+    }
+
+    static uint8_t symbol(char c) {
+        if (c >= 'a' && c <= 'g') return static_cast<uint8_t>(2 + c - 'a');
+        if (c >= 'A' && c <= 'G') return static_cast<uint8_t>(2 + c - 'A');
+        return 9;
+    }
+
+    /**
+     * Index every key of the corpus (row i of the index is corpus index i)
+     */
+    void build(const Corpus& corpus) {
+        clear();
+        size_t keys = corpus.size();
+        std::vector<uint8_t> text;
+        text.reserve(corpus.key_bytes() + keys + 1);
+        key_starts_.reserve(keys);
+        for (size_t k = 0; k < keys; k++) {
+            key_starts_.push_back(static_cast<uint32_t>(text.size()));
+            const char* key = corpus.key(k);
+            int length = corpus.key_length(k);
+            for (int i = 0; i < length; i++) text.push_back(symbol(key[i]));
+            text.push_back(1);
+        }
+        text.push_back(0);
+        epoch_ = corpus.epoch();
+
+        std::vector<uint32_t> sa = suffix_array(text);
+        size_t n = text.size();
+
+        bwt_.resize(n);
+        for (size_t i = 0; i < n; i++) bwt_[i] = text[sa[i] == 0 ? n - 1 : sa[i] - 1];
+
+        // C[s]: number of symbols smaller than s
+        uint32_t totals[SYMBOLS] = {0};
+        for (size_t i = 0; i < n; i++) totals[text[i]]++;
+        count_[0] = 0;
+        for (int s = 0; s < SYMBOLS; s++) count_[s + 1] = count_[s] + totals[s];
+
+        // Occurrences before every OCC_STEP-th row
+        size_t checkpoints = n / OCC_STEP + 1;
+        occ_.assign(checkpoints * SYMBOLS, 0);
+        uint32_t running[SYMBOLS] = {0};
+        for (size_t i = 0; i < n; i++) {
+            if (i % OCC_STEP == 0) std::copy(running, running + SYMBOLS, &occ_[(i / OCC_STEP) * SYMBOLS]);
+            running[bwt_[i]]++;
+        }
+        if (n % OCC_STEP == 0) std::copy(running, running + SYMBOLS, &occ_[(n / OCC_STEP) * SYMBOLS]);
+
+        // Keep the rows whose suffix starts at a multiple of SA_STEP
+        sampled_.assign(n / 64 + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            if (sa[i] % SA_STEP == 0) {
+                sampled_[i / 64] |= uint64_t(1) << (i % 64);
+                samples_.push_back(sa[i]);
+            }
+        }
+        sampled_rank_.resize(sampled_.size());
+        uint32_t before = 0;
+        for (size_t w = 0; w < sampled_.size(); w++) {
+            sampled_rank_[w] = before;
+            before += static_cast<uint32_t>(popcount(sampled_[w]));
+        }
+    }
+
+    /**
+     * Rows of the suffixes starting with the pattern
+     * @return Half-open range [lo, hi), empty when the pattern does not occur
+     */
+    void find(const char* pattern, int length, size_t& lo, size_t& hi) const {
+        lo = 0;
+        hi = bwt_.size();
+        for (int i = length - 1; i >= 0 && lo < hi; i--) {
+            uint8_t s = symbol(pattern[i]);
+            lo = count_[s] + occ(s, lo);
+            hi = count_[s] + occ(s, hi);
+        }
+        if (lo > hi) hi = lo;
+    }
+
+    // Text position of the suffix at a row, walking LF to the nearest sample
+    size_t locate(size_t row) const {
+        size_t steps = 0;
+        while (!(sampled_[row / 64] >> (row % 64) & 1)) {
+            uint8_t s = bwt_[row];
+            row = count_[s] + occ(s, row);
+            steps++;
+        }
+        return samples_[sampled_rank(row)] + steps;
+    }
+
+    /**
+     * Key holding a text position
+     * @param offset Set to the position within the key
+     */
+    uint32_t key_at(size_t position, int& offset) const {
+        size_t k = std::upper_bound(key_starts_.begin(), key_starts_.end(), static_cast<uint32_t>(position))
+                - key_starts_.begin() - 1;
+        offset = static_cast<int>(position - key_starts_[k]);
+        return static_cast<uint32_t>(k);
+    }
+
+private:
+    static const size_t OCC_STEP = 64;
+    static const uint32_t SA_STEP = 16;
+
+    static int popcount(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(v);
+#else
+        int bits = 0;
+        for (; v; v &= v - 1) bits++;
+        return bits;
+#endif
+    }
+
+    // Occurrences of s in bwt[0, row)
+    size_t occ(uint8_t s, size_t row) const {
+        size_t base = row / OCC_STEP;
+        size_t result = occ_[base * SYMBOLS + s];
+        for (size_t i = base * OCC_STEP; i < row; i++) result += bwt_[i] == s;
+        return result;
+    }
+
+    size_t sampled_rank(size_t row) const {
+        uint64_t below = sampled_[row / 64] & ((uint64_t(1) << (row % 64)) - 1);
+        return sampled_rank_[row / 64] + popcount(below);
+    }
+
+    /**
+     * Suffix array by prefix doubling: ranks by the first h symbols are
+     * refined to 2h with two stable counting-sort passes, O(n log n) overall.
+     * The text ends with the unique smallest symbol 0.
+     */
+    static std::vector<uint32_t> suffix_array(const std::vector<uint8_t>& text) {
+        size_t n = text.size();
+        std::vector<uint32_t> sa(n), rank(n), next(n), buckets(std::max<size_t>(n, SYMBOLS) + 1);
+
+        // Order by the first symbol
+        for (size_t i = 0; i < n; i++) buckets[text[i] + 1]++;
+        for (int s = 0; s < SYMBOLS; s++) buckets[s + 1] += buckets[s];
+        for (size_t i = 0; i < n; i++) sa[buckets[text[i]]++] = static_cast<uint32_t>(i);
+        for (size_t i = 0; i < n; i++) rank[i] = text[i];
+
+        uint32_t classes = SYMBOLS;
+        for (size_t h = 1; ; h <<= 1) {
+            // Sort by the second half: suffixes running off the end come first
+            size_t filled = 0;
+            for (size_t i = h < n ? n - h : 0; i < n; i++) next[filled++] = static_cast<uint32_t>(i);
+            for (size_t i = 0; i < n; i++) {
+                if (sa[i] >= h) next[filled++] = static_cast<uint32_t>(sa[i] - h);
+            }
+            // Then stably by the first half
+            std::fill(buckets.begin(), buckets.begin() + classes + 1, 0u);
+            for (size_t i = 0; i < n; i++) buckets[rank[i] + 1]++;
+            for (uint32_t c = 0; c < classes; c++) buckets[c + 1] += buckets[c];
+            for (size_t i = 0; i < n; i++) sa[buckets[rank[next[i]]]++] = next[i];
+
+            next[sa[0]] = 0;
+            classes = 1;
+            for (size_t i = 1; i < n; i++) {
+                uint32_t a = sa[i - 1];
+                uint32_t b = sa[i];
+                bool same = rank[a] == rank[b]
+                        && (a + h < n ? rank[a + h] : UINT32_MAX) == (b + h < n ? rank[b + h] : UINT32_MAX);
+                if (!same) classes++;
+                next[b] = classes - 1;
+            }
+            rank.swap(next);
+            if (classes == n) break;
+        }
+        return sa;
+    }
+
+    std::vector<uint8_t> bwt_;
+    std::vector<uint32_t> occ_;            // SYMBOLS counts per checkpoint
+    uint32_t count_[SYMBOLS + 1] = {0};
+    std::vector<uint32_t> samples_;        // text positions of the sampled rows, in row order
+    std::vector<uint64_t> sampled_;        // bit per row: is it sampled
+    std::vector<uint32_t> sampled_rank_;   // sampled rows before each word
+    std::vector<uint32_t> key_starts_;
+    uint64_t epoch_ = 0;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_FM_INDEX_H
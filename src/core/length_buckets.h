@@ -0,0 +1,127 @@
+/**
+ * Length-Bucketed Key Layout
+ *
+ * Search keys range from a few dozen to several hundred notes, and a
+ * substring alignment costs pattern x key cells, so tunes in corpus order
+ * make uneven work: a block or thread chunk that happens to hold long keys
+ * finishes well after the rest. This layout copies the keys into one buffer
+ * sorted by length (ties in corpus order) and groups them into buckets of
+ * BUCKET_WIDTH lengths, so a scan walks memory sequentially, neighbouring
+ * keys cost about the same, and a scheduler can split work by cells.
+ *
+ * Entries are addressed by position in the layout; index() and position()
+ * map between positions and corpus indices, which stay the tunes' identity.
+ * Tunes appended after build() are not copied: they follow the laid-out
+ * ones in corpus order, so their position is their corpus index, and their
+ * keys are read from the corpus. Rebuild when current() turns false (the
+ * corpus was cleared) or when the tail has grown too long to scan unsorted.
+ */
+
+#ifndef TUNEPAL_CORE_LENGTH_BUCKETS_H
+#define TUNEPAL_CORE_LENGTH_BUCKETS_H
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+class LengthBuckets {
+public:
+    static const int BUCKET_WIDTH = 32;
+
+    struct Bucket {
+        int min_length;     // shortest key in the bucket
+        int max_length;     // longest key in the bucket
+        uint32_t begin;     // first position
+        uint32_t end;       // one past the last position
+    };
+
+    void clear() {
+        data_.clear();
+        offsets_.clear();
+        indices_.clear();
+        positions_.clear();
+        buckets_.clear();
+        built_ = false;
+    }
+
+    void build(const Corpus& corpus) {
+        size_t count = corpus.size();
+        int longest = 0;
+        for (size_t i = 0; i < count; i++) longest = std::max(longest, corpus.key_length(i));
+
+        // Counting sort by exact length keeps equal lengths in corpus order
+        std::vector<uint32_t> starts(static_cast<size_t>(longest) + 2, 0);
+        for (size_t i = 0; i < count; i++) starts[corpus.key_length(i) + 1]++;
+        for (size_t l = 1; l < starts.size(); l++) starts[l] += starts[l - 1];
+
+        indices_.resize(count);
+        positions_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t p = starts[corpus.key_length(i)]++;
+            indices_[p] = static_cast<uint32_t>(i);
+            positions_[i] = p;
+        }
+
+        data_.clear();
+        data_.reserve(corpus.key_bytes());
+        offsets_.resize(count + 1);
+        buckets_.clear();
+        for (size_t p = 0; p < count; p++) {
+            uint32_t index = indices_[p];
+            int length = corpus.key_length(index);
+            offsets_[p] = static_cast<uint32_t>(data_.size());
+            data_.append(corpus.key(index), length);
+
+            if (buckets_.empty() || length / BUCKET_WIDTH != buckets_.back().min_length / BUCKET_WIDTH) {
+                Bucket bucket = {length, length, static_cast<uint32_t>(p), static_cast<uint32_t>(p)};
+                buckets_.push_back(bucket);
+            }
+            buckets_.back().max_length = length;
+            buckets_.back().end = static_cast<uint32_t>(p + 1);
+        }
+        offsets_[count] = static_cast<uint32_t>(data_.size());
+
+        epoch_ = corpus.epoch();
+        built_ = true;
+    }
+
+    // False once the corpus has been cleared since build(); appends keep it current
+    bool current(const Corpus& corpus) const { return built_ && epoch_ == corpus.epoch(); }
+
+    // Corpus entries [0, size()) are laid out; the rest are the appended tail
+    size_t size() const { return indices_.size(); }
+    uint32_t index(size_t position) const { return position < indices_.size() ? indices_[position] : static_cast<uint32_t>(position); }
+    uint32_t position(size_t index) const { return index < positions_.size() ? positions_[index] : static_cast<uint32_t>(index); }
+    // Laid-out positions only
+    const char* key(size_t position) const { return data_.data() + offsets_[position]; }
+    int key_length(size_t position) const { return static_cast<int>(offsets_[position + 1] - offsets_[position]); }
+
+    size_t bucket_count() const { return buckets_.size(); }
+    const Bucket& bucket(size_t b) const { return buckets_[b]; }
+
+    // Reorder corpus indices into layout order (shortest keys first, then the tail)
+    void arrange(std::vector<uint32_t>& indices) const {
+        std::sort(indices.begin(), indices.end(), [this](uint32_t a, uint32_t b) {
+            return position(a) < position(b);
+        });
+    }
+
+private:
+    std::string data_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> indices_;
+    std::vector<uint32_t> positions_;
+    std::vector<Bucket> buckets_;
+    uint64_t epoch_ = 0;
+    bool built_ = false;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_LENGTH_BUCKETS_H
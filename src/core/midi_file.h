@@ -0,0 +1,203 @@
+/**
+ * Standard MIDI File Reading
+ *
+ * Parses format 0 and 1 SMF data into one list of channel events, merged
+ * across tracks and stamped with the output sample frame they fall on (the
+ * tempo map is applied while parsing), so a sequencer can apply each event
+ * at its exact sample instead of once per audio block. Also builds songs
+ * from a plain list of note numbers, for tunes stored without an SMF.
+ */
+
+#ifndef TUNEPAL_CORE_MIDI_FILE_H
+#define TUNEPAL_CORE_MIDI_FILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+// Channel message (note on/off, control change, program change, pitch bend, ...)
+struct MidiEvent {
+    uint64_t frame;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+struct MidiSong {
+    std::vector<MidiEvent> events;   // ordered by frame
+    uint64_t length_frames = 0;
+    double sample_rate = 0.0;
+
+    double seconds() const { return sample_rate > 0.0 ? length_frames / sample_rate : 0.0; }
+};
+
+/**
+ * Parse an SMF held in memory
+ * @param data File contents
+ * @param size Size in bytes
+ * @param sample_rate Rate the event frames are expressed in
+ * @param out Parsed song
+ * @param error Set to a description of the problem on failure
+ * @return true on success
+ */
+inline bool parse_midi_file(const uint8_t* data, size_t size, double sample_rate, MidiSong& out, std::string& error) {
+    // Reads past the end return zeros and stay at the end
+    struct Reader {
+        const uint8_t* p;
+        const uint8_t* end;
+        uint8_t u8() { return p < end ? *p++ : 0; }
+        uint16_t u16() { uint16_t hi = u8(); return static_cast<uint16_t>((hi << 8) | u8()); }
+        uint32_t u32() { uint32_t hi = u16(); return (hi << 16) | u16(); }
+        uint32_t vlq() {
+            uint32_t v = 0;
+            for (int i = 0; i < 4 && p < end; i++) {
+                uint8_t b = *p++;
+                v = (v << 7) | (b & 0x7F);
+                if (!(b & 0x80)) break;
+            }
+            return v;
+        }
+        void skip(size_t n) { p += std::min(n, static_cast<size_t>(end - p)); }
+    };
+    struct TickEvent {
+        uint64_t tick;
+        uint32_t order;     // file order breaks ties
+        uint32_t tempo;     // microseconds per quarter; 0 for channel events
+        MidiEvent event;
+    };
+
+    Reader in = {data, data + size};
+    if (size < 14 || in.u32() != 0x4D546864 /* MThd */) {
+        error = "not a standard MIDI file";
+        return false;
+    }
+    uint32_t header_length = in.u32();
+    uint16_t format = in.u16();
+    uint16_t tracks = in.u16();
+    uint16_t division = in.u16();
+    in.p = data + 8;
+    in.skip(header_length);
+    if (format > 1 || division == 0) {
+        error = format > 1 ? "format 2 files are not supported" : "invalid time division";
+        return false;
+    }
+
+    std::vector<TickEvent> events;
+    for (uint16_t t = 0; t < tracks && in.p + 8 <= in.end; t++) {
+        uint32_t id = in.u32();
+        uint32_t length = in.u32();
+        const uint8_t* track_end = in.p + std::min<size_t>(length, in.end - in.p);
+        if (id != 0x4D54726B /* MTrk */) {
+            in.p = track_end;
+            t--;
+            continue;
+        }
+        Reader track = {in.p, track_end};
+        uint64_t tick = 0;
+        uint8_t running = 0;
+        while (track.p < track.end) {
+            tick += track.vlq();
+            uint8_t status = track.p < track.end ? *track.p : 0;
+            if (status & 0x80) {
+                track.p++;
+            } else {
+                status = running;   // running status: the byte is already data
+            }
+            if (status == 0xFF) {
+                uint8_t type = track.u8();
+                uint32_t meta_length = track.vlq();
+                if (type == 0x51 && meta_length == 3 && track.p + 3 <= track.end) {
+                    TickEvent tempo = {tick, static_cast<uint32_t>(events.size()),
+                                       static_cast<uint32_t>((track.p[0] << 16) | (track.p[1] << 8) | track.p[2]), MidiEvent()};
+                    events.push_back(tempo);
+                }
+                if (type == 0x2F) break;
+                track.skip(meta_length);
+            } else if (status == 0xF0 || status == 0xF7) {
+                track.skip(track.vlq());   // system exclusive
+            } else if (status >= 0x80) {
+                running = status;
+                MidiEvent event = {0, status, track.u8(), 0};
+                uint8_t kind = status & 0xF0;
+                if (kind != 0xC0 && kind != 0xD0) event.data2 = track.u8();
+                TickEvent tick_event = {tick, static_cast<uint32_t>(events.size()), 0, event};
+                events.push_back(tick_event);
+            } else {
+                break;   // data byte without a running status: corrupt track
+            }
+        }
+        in.p = track_end;
+    }
+    std::sort(events.begin(), events.end(), [](const TickEvent& a, const TickEvent& b) {
+        return a.tick != b.tick ? a.tick < b.tick : a.order < b.order;
+    });
+
+    // Walk the tempo map; SMPTE divisions have a fixed tick length
+    double seconds_per_tick;
+    bool smpte = (division & 0x8000) != 0;
+    if (smpte) {
+        int fps = -static_cast<int8_t>(division >> 8);
+        seconds_per_tick = 1.0 / (std::max(fps, 1) * std::max(division & 0xFF, 1));
+    } else {
+        seconds_per_tick = 0.5 / division;   // 120 bpm until the first tempo event
+    }
+    double seconds = 0.0;
+    uint64_t last_tick = 0;
+    out.events.clear();
+    out.sample_rate = sample_rate;
+    for (const TickEvent& e : events) {
+        seconds += (e.tick - last_tick) * seconds_per_tick;
+        last_tick = e.tick;
+        if (e.tempo > 0) {
+            if (!smpte) seconds_per_tick = e.tempo / 1e6 / division;
+            continue;
+        }
+        MidiEvent event = e.event;
+        event.frame = static_cast<uint64_t>(std::llround(seconds * sample_rate));
+        out.events.push_back(event);
+    }
+    out.length_frames = out.events.empty() ? 0 : out.events.back().frame;
+    return true;
+}
+
+/**
+ * Song playing a list of note numbers, one unit each; a number repeated is
+ * one held note, as in search keys
+ * @param notes MIDI note numbers (0-127)
+ * @param seconds_per_unit Length of one entry
+ * @param program General MIDI program for channel 0
+ */
+inline MidiSong midi_song_from_notes(const std::vector<int>& notes, double seconds_per_unit, double sample_rate,
+                                     int program = 0, int velocity = 100) {
+    MidiSong song;
+    song.sample_rate = sample_rate;
+    MidiEvent select = {0, 0xC0, static_cast<uint8_t>(program & 0x7F), 0};
+    song.events.push_back(select);
+    size_t i = 0;
+    while (i < notes.size()) {
+        size_t run = 1;
+        while (i + run < notes.size() && notes[i + run] == notes[i]) run++;
+        uint64_t on = static_cast<uint64_t>(std::llround(i * seconds_per_unit * sample_rate));
+        uint64_t off = static_cast<uint64_t>(std::llround((i + run) * seconds_per_unit * sample_rate));
+        if (notes[i] >= 0 && notes[i] < 128) {
+            uint8_t key = static_cast<uint8_t>(notes[i]);
+            // Appended in frame order: each note-off lands before the next note-on
+            MidiEvent note_on = {on, 0x90, key, static_cast<uint8_t>(velocity & 0x7F)};
+            MidiEvent note_off = {off, 0x80, key, 0};
+            song.events.push_back(note_on);
+            song.events.push_back(note_off);
+        }
+        i += run;
+    }
+    song.length_frames = song.events.empty() ? 0 : song.events.back().frame;
+    return song;
+}
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_MIDI_FILE_H
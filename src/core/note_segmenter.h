@@ -0,0 +1,467 @@
+/**
+ * Streaming Note Segmenter
+ *
+ * Turns microphone audio into the letter query used by search, while the
+ * recording is still running. Each analysis frame is windowed and
+ * transformed once; the spectrum feeds both
+ *   - a spectral-flux onset detector (log-compressed magnitude increase,
+ *     compared against a running mean), which splits repeated notes of the
+ *     same pitch, and
+ *   - a harmonic product spectrum pitch estimate, spelled to a letter the same
+ *     way record.gd did (sharps fold down: C# -> C, F# -> F, ...).
+ * A letter becomes a note once it has been stable for a few frames. When a
+ * note ends its (note, onset, duration) event is emitted; notes shorter than
+ * the minimum are folded into the previous one.
+ *
+ * The unit length is the mean of the most populated duration bin (durations
+ * within 33% of a bin's mean share it), updated after every event. Each note
+ * is written as round(duration / unit) copies of its letter (at least one),
+ * so the query grows as notes arrive and is only re-rendered when the unit
+ * changes.
+ */
+
+#ifndef TUNEPAL_CORE_NOTE_SEGMENTER_H
+#define TUNEPAL_CORE_NOTE_SEGMENTER_H
+
+#include "fft.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+struct NoteEvent {
+    char note;
+    double onset;      // seconds since reset()
+    double duration;   // seconds
+    float frequency;   // mean detected frequency, Hz
+};
+
+struct SegmenterConfig {
+    double sample_rate = 44100.0;
+    int frame_size = 4096;            // power of two
+    int hop_size = 512;
+    float min_frequency = 100.0f;     // same search range as the old spectrum scan
+    float max_frequency = 8000.0f;
+    float silence_rms = 0.005f;       // frames quieter than this end the current note
+    int stable_frames = 3;            // frames a letter must persist to start a note
+    double min_note_duration = 0.1;   // shorter notes are folded into the previous one
+    double unit_tolerance = 0.33;     // duration bin width, relative to the bin mean
+    float onset_ratio = 1.5f;         // flux must exceed this multiple of its running mean
+    float onset_floor = 1.5f;         // ... and this absolute value
+    double min_onset_interval = 0.05; // seconds
+};
+
+class NoteSegmenter {
+public:
+    explicit NoteSegmenter(const SegmenterConfig& config = SegmenterConfig()) {
+        configure(config);
+    }
+
+    /**
+     * Change the configuration; also resets the stream
+     */
+    void configure(const SegmenterConfig& config) {
+        config_ = config;
+        size_t n = static_cast<size_t>(config_.frame_size);
+        fft_.resize(n);
+        window_.resize(n);
+        float window_sum = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            window_[i] = 0.5f - 0.5f * static_cast<float>(std::cos(2.0 * 3.14159265358979323846 * i / n));
+            window_sum += window_[i];
+        }
+        // Scale so a full-scale sine peaks at 1.0
+        magnitude_scale_ = window_sum > 0.0f ? 2.0f / window_sum : 1.0f;
+        re_.resize(n);
+        im_.resize(n);
+        magnitude_.resize(n / 2 + 1);
+        previous_log_.resize(n / 2 + 1);
+        flux_history_.resize(FLUX_HISTORY);
+        reset();
+    }
+
+    const SegmenterConfig& config() const { return config_; }
+
+    void reset() {
+        buffer_.clear();
+        samples_ = 0;
+        frames_ = 0;
+        time_ = 0.0;
+        std::fill(previous_log_.begin(), previous_log_.end(), 0.0f);
+        std::fill(flux_history_.begin(), flux_history_.end(), 0.0f);
+        flux_count_ = 0;
+        previous_flux_ = 0.0f;
+        last_onset_ = -1.0;
+        last_onset_frame_ = -1;
+        candidate_ = 0;
+        candidate_frames_ = 0;
+        candidate_start_ = 0.0;
+        candidate_start_frame_ = 0;
+        open_ = false;
+        events_.clear();
+        durations_.clear();
+        unit_ = 0.0;
+        query_.clear();
+    }
+
+    /**
+     * Feed mono samples
+     * @return Number of events completed by this call
+     */
+    size_t push(const float* samples, size_t count) {
+        size_t before = events_.size();
+        samples_ += count;
+        buffer_.insert(buffer_.end(), samples, samples + count);
+
+        size_t n = static_cast<size_t>(config_.frame_size);
+        size_t hop = static_cast<size_t>(config_.hop_size);
+        size_t read = 0;
+        while (buffer_.size() - read >= n) {
+            analyze(buffer_.data() + read);
+            read += hop;
+        }
+        if (read > 0) buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(read));
+        return events_.size() - before;
+    }
+
+    /**
+     * End of stream: close the note that is still sounding
+     * @return Number of events completed by this call
+     */
+    size_t finish() {
+        size_t before = events_.size();
+        // Whatever is sounding lasts to the end of the audio, past the last frame centre
+        close_note(std::max(time_, samples_ / config_.sample_rate));
+        candidate_frames_ = 0;
+        return events_.size() - before;
+    }
+
+    const std::vector<NoteEvent>& events() const { return events_; }
+    const std::string& query() const { return query_; }
+    double unit_length() const { return unit_; }
+
+    /**
+     * Letter for a frequency, matching record.gd's spelling table
+     */
+    static char spell(float frequency) {
+        static const char SPELLINGS[12] = {'C', 'C', 'D', 'D', 'E', 'F', 'F', 'G', 'G', 'A', 'A', 'B'};
+        long midi = std::lround(69.0 + 12.0 * std::log2(frequency / 440.0));
+        return SPELLINGS[((midi % 12) + 12) % 12];
+    }
+
+private:
+    static constexpr int FLUX_HISTORY = 16;
+    static constexpr int ONSET_BLOCKS = 32;   // onset resolution: frame_size / ONSET_BLOCKS samples
+    static constexpr int HARMONICS = 3;
+
+    void analyze(const float* frame) {
+        TraceSpan span("pitch frame", static_cast<int64_t>(frames_));
+        size_t n = static_cast<size_t>(config_.frame_size);
+        time_ = (static_cast<double>(frames_) * config_.hop_size + n / 2) / config_.sample_rate;
+        frames_++;
+
+        float energy = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            energy += frame[i] * frame[i];
+            re_[i] = frame[i] * window_[i];
+            im_[i] = 0.0f;
+        }
+        float rms = std::sqrt(energy / static_cast<float>(n));
+        fft_.forward(re_.data(), im_.data());
+
+        float flux = 0.0f;
+        for (size_t k = 0; k <= n / 2; k++) {
+            float mag = std::sqrt(re_[k] * re_[k] + im_[k] * im_[k]) * magnitude_scale_;
+            float log_mag = std::log1p(100.0f * mag);
+            float rise = log_mag - previous_log_[k];
+            if (rise > 0.0f) flux += rise;
+            previous_log_[k] = log_mag;
+            magnitude_[k] = mag;
+        }
+        detect_onset(flux, frame);
+
+        if (rms < config_.silence_rms) {
+            close_note(time_);
+            candidate_frames_ = 0;
+            return;
+        }
+
+        float frequency = estimate_pitch();
+        if (frequency <= 0.0f) {
+            close_note(time_);
+            candidate_frames_ = 0;
+            return;
+        }
+        track_pitch(spell(frequency), frequency);
+    }
+
+    // Records the time of the latest onset in last_onset_
+    void detect_onset(float flux, const float* frame) {
+        float mean = 0.0f;
+        int history = std::min(flux_count_, FLUX_HISTORY);
+        for (int i = 0; i < history; i++) mean += flux_history_[i];
+        if (history > 0) mean /= static_cast<float>(history);
+        flux_history_[flux_count_ % FLUX_HISTORY] = flux;
+        flux_count_++;
+
+        bool rising = flux > previous_flux_;
+        previous_flux_ = flux;
+        if (!rising || flux < config_.onset_floor || flux < config_.onset_ratio * mean) return;
+        double onset = locate_onset(frame);
+        if (last_onset_ >= 0.0 && onset - last_onset_ < config_.min_onset_interval) return;
+        last_onset_ = onset;
+        last_onset_frame_ = static_cast<long>(frames_);
+    }
+
+    /**
+     * The flux rises while an attack crosses the window, so the frame centre
+     * can be most of a window away from it; place the onset at the block of
+     * the frame whose energy rose most over the block before it
+     */
+    double locate_onset(const float* frame) const {
+        size_t n = static_cast<size_t>(config_.frame_size);
+        size_t block = std::max<size_t>(n / ONSET_BLOCKS, 1);
+        // Nothing came before the first frame
+        bool first = frames_ == 1;
+        float previous = 0.0f;
+        size_t best = 0;
+        float best_rise = 0.0f;
+        for (size_t b = 0; b + block <= n; b += block) {
+            float energy = 1e-9f;
+            for (size_t i = b; i < b + block; i++) energy += frame[i] * frame[i];
+            if (b > 0 || first) {
+                float rise = energy / (previous + 1e-9f);
+                if (rise > best_rise) {
+                    best_rise = rise;
+                    best = b;
+                }
+            }
+            previous = energy;
+        }
+        double frame_start = time_ - (n / 2) / config_.sample_rate;
+        return std::max(0.0, frame_start + best / config_.sample_rate);
+    }
+
+    /**
+     * Harmonic product spectrum over the configured range, refined by
+     * interpolating the peak of each harmonic
+     * @return Frequency in Hz, or 0 if nothing stands out
+     */
+    float estimate_pitch() const {
+        double bin_hz = config_.sample_rate / config_.frame_size;
+        size_t nyquist = static_cast<size_t>(config_.frame_size) / 2;
+        size_t lo = std::max<size_t>(1, static_cast<size_t>(std::ceil(config_.min_frequency / bin_hz)));
+        size_t hi = std::min(static_cast<size_t>(config_.max_frequency / bin_hz), (nyquist - 1) / HARMONICS);
+        if (lo > hi) return 0.0f;
+
+        float peak = 0.0f;
+        for (size_t k = lo; k < nyquist; k++) peak = std::max(peak, magnitude_[k]);
+
+        // The fundamental has to carry some energy itself, otherwise the
+        // leakage around a pure tone's subharmonics can win; the floor keeps
+        // missing upper harmonics from zeroing the product
+        float floor = 0.01f * peak;
+        size_t best = 0;
+        float best_score = 0.0f;
+        for (size_t k = lo; k <= hi; k++) {
+            if (magnitude_[k] < 0.1f * peak) continue;
+            float score = 1.0f;
+            for (int h = 1; h <= HARMONICS; h++) score *= magnitude_[k * h] + floor;
+            if (score > best_score) {
+                best_score = score;
+                best = k;
+            }
+        }
+        if (best == 0) return 0.0f;
+
+        double weighted = 0.0;
+        double weight = 0.0;
+        for (int h = 1; h <= HARMONICS; h++) {
+            size_t k = best * h;
+            // The harmonic may have landed on a neighbouring bin
+            if (magnitude_[k - 1] > magnitude_[k] && magnitude_[k - 1] >= magnitude_[k + 1]) k--;
+            else if (magnitude_[k + 1] > magnitude_[k]) k++;
+            if (k < 1 || k >= nyquist) continue;
+
+            double a = std::log(magnitude_[k - 1] + 1e-12);
+            double b = std::log(magnitude_[k] + 1e-12);
+            double c = std::log(magnitude_[k + 1] + 1e-12);
+            double denom = a - 2.0 * b + c;
+            double offset = denom < 0.0 ? 0.5 * (a - c) / denom : 0.0;
+            weighted += magnitude_[k] * (k + offset) * bin_hz / h;
+            weight += magnitude_[k];
+        }
+        return weight > 0.0 ? static_cast<float>(weighted / weight) : 0.0f;
+    }
+
+    void track_pitch(char letter, float frequency) {
+        if (candidate_frames_ > 0 && letter == candidate_) {
+            candidate_frames_++;
+        } else {
+            candidate_ = letter;
+            candidate_frames_ = 1;
+            candidate_start_ = time_;
+            candidate_start_frame_ = static_cast<long>(frames_);
+        }
+
+        if (open_ && letter == note_ && candidate_frames_ > config_.stable_frames) {
+            frequency_sum_ += frequency;
+            frequency_count_++;
+        }
+        if (candidate_frames_ < config_.stable_frames) return;
+
+        // An onset seen while the letter was settling marks where the note began;
+        // the attack itself can briefly pull the pitch off, so count from the
+        // frame the candidate letter first appeared rather than from now
+        bool recent_onset = last_onset_frame_ >= 0
+                && candidate_start_frame_ - last_onset_frame_ <= config_.stable_frames;
+        double start = recent_onset ? std::min(last_onset_, candidate_start_) : candidate_start_;
+
+        if (!open_) {
+            open_note(letter, frequency, start);
+        } else if (letter != note_) {
+            close_note(start);
+            open_note(letter, frequency, start);
+        } else if (recent_onset && last_onset_ > note_onset_) {
+            // Same letter played again
+            close_note(last_onset_);
+            open_note(letter, frequency, last_onset_);
+        }
+        if (candidate_frames_ == config_.stable_frames) last_onset_frame_ = -1;
+    }
+
+    void open_note(char letter, float frequency, double start) {
+        open_ = true;
+        note_ = letter;
+        note_onset_ = start;
+        frequency_sum_ = frequency;
+        frequency_count_ = 1;
+        last_onset_frame_ = -1;
+    }
+
+    void close_note(double end) {
+        if (!open_) return;
+        open_ = false;
+        double duration = end - note_onset_;
+        if (duration <= 0.0) return;
+
+        if (duration < config_.min_note_duration) {
+            // Too short to be a note of its own; the time belongs to the previous one
+            if (events_.empty()) return;
+            NoteEvent& last = events_.back();
+            remove_duration(last.duration);
+            last.duration += duration;
+            insert_duration(last.duration);
+            update_unit(true);
+            return;
+        }
+
+        NoteEvent event;
+        event.note = note_;
+        event.onset = note_onset_;
+        event.duration = duration;
+        event.frequency = static_cast<float>(frequency_sum_ / frequency_count_);
+        events_.push_back(event);
+        insert_duration(duration);
+        update_unit(false);
+    }
+
+    void insert_duration(double duration) {
+        durations_.insert(std::upper_bound(durations_.begin(), durations_.end(), duration), duration);
+    }
+
+    void remove_duration(double duration) {
+        std::vector<double>::iterator it = std::lower_bound(durations_.begin(), durations_.end(), duration);
+        if (it != durations_.end() && *it == duration) durations_.erase(it);
+    }
+
+    /**
+     * Re-estimate the unit and extend the query; the whole query is only
+     * rewritten when the unit moved or an earlier event changed
+     */
+    void update_unit(bool last_event_changed) {
+        double best_mean = 0.0;
+        size_t best_count = 0;
+        double bin_sum = 0.0;
+        size_t bin_count = 0;
+        for (size_t i = 0; i <= durations_.size(); i++) {
+            double mean = bin_count > 0 ? bin_sum / bin_count : 0.0;
+            if (i < durations_.size() && (bin_count == 0 || std::fabs(mean - durations_[i]) / mean <= config_.unit_tolerance)) {
+                bin_sum += durations_[i];
+                bin_count++;
+                continue;
+            }
+            if (bin_count > best_count) {
+                best_count = bin_count;
+                best_mean = mean;
+            }
+            if (i < durations_.size()) {
+                bin_sum = durations_[i];
+                bin_count = 1;
+            }
+        }
+
+        if (best_mean != unit_ || last_event_changed) {
+            unit_ = best_mean;
+            query_.clear();
+            for (size_t i = 0; i < events_.size(); i++) append_event(events_[i]);
+        } else if (!events_.empty()) {
+            append_event(events_.back());
+        }
+    }
+
+    void append_event(const NoteEvent& event) {
+        long repeats = 1;
+        if (unit_ > 0.0) repeats = std::max<long>(1, std::lround(event.duration / unit_));
+        query_.append(static_cast<size_t>(repeats), event.note);
+    }
+
+    SegmenterConfig config_;
+    Fft fft_;
+    std::vector<float> window_;
+    float magnitude_scale_ = 1.0f;
+    std::vector<float> re_;
+    std::vector<float> im_;
+    std::vector<float> magnitude_;
+
+    // Stream position
+    std::vector<float> buffer_;
+    size_t samples_ = 0;
+    size_t frames_ = 0;
+    double time_ = 0.0;
+
+    // Onset detection
+    std::vector<float> previous_log_;
+    std::vector<float> flux_history_;
+    int flux_count_ = 0;
+    float previous_flux_ = 0.0f;
+    double last_onset_ = -1.0;
+    long last_onset_frame_ = -1;
+
+    // Pitch stability
+    char candidate_ = 0;
+    int candidate_frames_ = 0;
+    double candidate_start_ = 0.0;
+    long candidate_start_frame_ = 0;
+
+    // Note currently sounding
+    bool open_ = false;
+    char note_ = 0;
+    double note_onset_ = 0.0;
+    double frequency_sum_ = 0.0;
+    int frequency_count_ = 0;
+
+    std::vector<NoteEvent> events_;
+    std::vector<double> durations_;   // sorted, for the unit estimate
+    double unit_ = 0.0;
+    std::string query_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_NOTE_SEGMENTER_H
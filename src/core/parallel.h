@@ -0,0 +1,243 @@
+/**
+ * Minimal Parallel-For
+ *
+ * Splits [0, count) into contiguous chunks and runs them on a persistent
+ * pool of worker threads, the same way record.gd used to split the corpus
+ * across Godot Threads. The workers live for the lifetime of the library, so
+ * their ScratchArenas survive between queries and a steady-state search does
+ * not create threads or allocate.
+ *
+ * parallel_for_weighted cuts the range by estimated cost instead of item
+ * count, so a chunk of long tunes is not left running after the rest.
+ *
+ * With tracing on (core/trace.h) every chunk is a span on its worker's row,
+ * so an uneven split shows up as one long bar.
+ */
+
+#ifndef TUNEPAL_CORE_PARALLEL_H
+#define TUNEPAL_CORE_PARALLEL_H
+
+#include "scratch_arena.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tunepal {
+
+class ThreadPool {
+public:
+    typedef void (*Invoke)(void* context, size_t begin, size_t end, int worker);
+
+    static ThreadPool& instance() {
+        static ThreadPool pool(hardware_threads());
+        return pool;
+    }
+
+    static int hardware_threads() {
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw == 0 ? 1 : static_cast<int>(hw);
+    }
+
+    // True while running pool work (nested parallel_for runs inline there)
+    static bool& on_worker_thread() {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    explicit ThreadPool(int workers) {
+        for (int i = 1; i < workers; i++) {
+            threads_.emplace_back(&ThreadPool::worker_loop, this, i);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) thread.join();
+    }
+
+    // Workers including the calling thread
+    int size() const { return static_cast<int>(threads_.size()) + 1; }
+
+    /**
+     * Run invoke(context, begin, end, worker) for `chunks` equal ranges of
+     * [0, count). The caller works too and returns once every chunk is done.
+     * Calls from different threads are serialized.
+     * @param bounds Optional chunks + 1 ascending range boundaries to use
+     *        instead of equal ranges (bounds[0] = 0, bounds[chunks] = count)
+     */
+    void run(size_t count, size_t chunks, Invoke invoke, void* context, const size_t* bounds = nullptr) {
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+
+        Job job;
+        job.invoke = invoke;
+        job.context = context;
+        job.count = count;
+        job.chunks = chunks;
+        job.bounds = bounds;
+        job.next.store(0);
+        job.pending.store(chunks);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            generation_++;
+        }
+        wake_.notify_all();
+
+        // Nested parallel_for calls from the job run inline instead of deadlocking
+        bool& nested = on_worker_thread();
+        bool was_nested = nested;
+        nested = true;
+        work(job, 0);
+        nested = was_nested;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&]() { return job.pending.load() == 0 && job.participants == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    struct Job {
+        Invoke invoke;
+        void* context;
+        size_t count;
+        size_t chunks;
+        const size_t* bounds;
+        std::atomic<size_t> next;
+        std::atomic<size_t> pending;
+        int participants = 0;  // Guarded by mutex_
+    };
+
+    void work(Job& job, int worker) {
+        for (;;) {
+            size_t chunk = job.next.fetch_add(1);
+            if (chunk >= job.chunks) return;
+            size_t begin = job.bounds ? job.bounds[chunk] : job.count * chunk / job.chunks;
+            size_t end = job.bounds ? job.bounds[chunk + 1] : job.count * (chunk + 1) / job.chunks;
+            if (begin < end) {
+                TraceSpan span("chunk", static_cast<int64_t>(end - begin));
+                job.invoke(job.context, begin, end, worker);
+            }
+            job.pending.fetch_sub(1);
+        }
+    }
+
+    void worker_loop(int worker) {
+        on_worker_thread() = true;
+        Trace::set_worker(worker);
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [&]() { return stopping_ || (job_ != nullptr && generation_ != seen); });
+            if (stopping_) return;
+            seen = generation_;
+            Job* job = job_;
+            job->participants++;
+            lock.unlock();
+
+            work(*job, worker);
+
+            lock.lock();
+            job->participants--;
+            done_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Job* job_ = nullptr;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+};
+
+inline int worker_count() {
+    return ThreadPool::instance().size();
+}
+
+/**
+ * Run fn(begin, end, worker) over [0, count) on up to worker_count() threads
+ * @param min_chunk Smallest range worth handing to its own thread
+ */
+template <typename Fn>
+void parallel_for(size_t count, size_t min_chunk, Fn&& fn) {
+    if (count == 0) return;
+
+    size_t chunks = (count + min_chunk - 1) / std::max<size_t>(min_chunk, 1);
+    if (chunks <= 1 || ThreadPool::on_worker_thread()) {
+        fn(size_t(0), count, 0);
+        return;
+    }
+
+    ThreadPool& pool = ThreadPool::instance();
+    chunks = std::min(chunks, static_cast<size_t>(pool.size()));
+    if (chunks <= 1) {
+        fn(size_t(0), count, 0);
+        return;
+    }
+
+    typedef typename std::remove_reference<Fn>::type Callable;
+    pool.run(count, chunks, [](void* context, size_t begin, size_t end, int worker) {
+        (*static_cast<Callable*>(context))(begin, end, worker);
+    }, const_cast<void*>(static_cast<const void*>(&fn)));
+}
+
+/**
+ * parallel_for whose chunks carry equal total weight rather than equal item
+ * counts, for items whose cost varies (e.g. DP cells per tune)
+ * @param weight weight(i): estimated cost of item i
+ * @param min_weight Smallest total weight worth handing to its own thread
+ */
+template <typename Weight, typename Fn>
+void parallel_for_weighted(size_t count, Weight weight, size_t min_weight, Fn&& fn) {
+    if (count == 0) return;
+    if (ThreadPool::on_worker_thread()) {
+        fn(size_t(0), count, 0);
+        return;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += weight(i);
+    ThreadPool& pool = ThreadPool::instance();
+    size_t chunks = std::min(total / std::max<size_t>(min_weight, 1), static_cast<size_t>(pool.size()));
+    if (chunks <= 1) {
+        fn(size_t(0), count, 0);
+        return;
+    }
+
+    // Chunk c ends at the first item whose running weight reaches c + 1 shares
+    ScratchArena& arena = ScratchArena::local();
+    ScratchArena::Scope scope(arena);
+    size_t* bounds = arena.alloc<size_t>(chunks + 1);
+    bounds[0] = 0;
+    size_t chunk = 1;
+    size_t running = 0;
+    for (size_t i = 0; i < count && chunk < chunks; i++) {
+        running += weight(i);
+        while (chunk < chunks && running * chunks >= total * chunk) bounds[chunk++] = i + 1;
+    }
+    while (chunk <= chunks) bounds[chunk++] = count;
+
+    typedef typename std::remove_reference<Fn>::type Callable;
+    pool.run(count, chunks, [](void* context, size_t begin, size_t end, int worker) {
+        (*static_cast<Callable*>(context))(begin, end, worker);
+    }, const_cast<void*>(static_cast<const void*>(&fn)), bounds);
+}
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_PARALLEL_H
@@ -0,0 +1,179 @@
+/**
+ * LRU Query Result Cache
+ *
+ * Remembers the per-candidate scores of recent searches so that re-running a
+ * search (changing a filter back, retrying after a false start, toggling the
+ * matcher) is answered without touching the corpus.
+ *
+ * Entries may also keep the last DP row of every candidate. A query that
+ * extends a cached one by a few notes then resumes from those rows instead of
+ * rescanning from the first note.
+ *
+ * Entries are keyed by (context, query): the context encodes the matcher, the
+ * filter set and the corpus generation, the query is the normalized note
+ * string. The cache is bounded by a byte budget rather than an entry count,
+ * since entries with rows are orders of magnitude larger than ones without.
+ */
+
+#ifndef TUNEPAL_CORE_QUERY_CACHE_H
+#define TUNEPAL_CORE_QUERY_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tunepal {
+
+template <typename Cell>
+struct QueryCacheEntry {
+    std::string context;
+    std::string query;
+    std::vector<uint32_t> candidates;   // Corpus indices that were scored
+    std::vector<float> scores;          // One per candidate (matcher-specific units)
+    std::vector<Cell> rows;             // Last DP row per candidate, back-to-back (optional)
+    std::vector<uint32_t> row_offsets;  // Start of each candidate's row in `rows`
+
+    bool has_rows() const { return !rows.empty(); }
+
+    size_t bytes() const {
+        return sizeof(*this) + context.size() + query.size() +
+               candidates.size() * sizeof(uint32_t) + scores.size() * sizeof(float) +
+               rows.size() * sizeof(Cell) + row_offsets.size() * sizeof(uint32_t);
+    }
+};
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t prefix_hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+};
+
+template <typename Cell>
+class QueryCache {
+public:
+    using Entry = QueryCacheEntry<Cell>;
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    explicit QueryCache(size_t budget_bytes = 32 * 1024 * 1024) : budget_(budget_bytes) {}
+
+    /**
+     * Exact lookup; counts a hit or a miss
+     */
+    EntryPtr find(const std::string& context, const std::string& query) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(make_key(context, query));
+        if (it == map_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        stats_.hits++;
+        return *it->second;
+    }
+
+    /**
+     * Longest cached proper prefix of `query` that kept its DP rows
+     * @param max_extension Only consider prefixes at most this many notes shorter
+     */
+    EntryPtr find_prefix(const std::string& context, const std::string& query, int max_extension) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int shortest = static_cast<int>(query.size()) - max_extension;
+        if (shortest < 1) shortest = 1;
+
+        for (int length = static_cast<int>(query.size()) - 1; length >= shortest; length--) {
+            auto it = map_.find(make_key(context, query.substr(0, length)));
+            if (it != map_.end() && (*it->second)->has_rows()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                stats_.prefix_hits++;
+                return *it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Insert an entry and evict least-recently-used entries down to the budget.
+     * Entries larger than the whole budget are not stored.
+     */
+    void insert(std::shared_ptr<Entry> entry) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t entry_bytes = entry->bytes();
+        if (entry_bytes > budget_) return;
+
+        std::string key = make_key(entry->context, entry->query);
+        auto existing = map_.find(key);
+        if (existing != map_.end()) {
+            bytes_ -= (*existing->second)->bytes();
+            lru_.erase(existing->second);
+            map_.erase(existing);
+        }
+
+        lru_.push_front(std::move(entry));
+        map_[key] = lru_.begin();
+        bytes_ += entry_bytes;
+        evict_to(budget_);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        map_.clear();
+        bytes_ = 0;
+    }
+
+    void set_budget(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budget_ = budget_bytes;
+        evict_to(budget_);
+    }
+
+    size_t budget() const { return budget_; }
+
+    QueryCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        QueryCacheStats result = stats_;
+        result.entries = lru_.size();
+        result.bytes = bytes_;
+        result.budget = budget_;
+        return result;
+    }
+
+private:
+    static std::string make_key(const std::string& context, const std::string& query) {
+        std::string key;
+        key.reserve(context.size() + query.size() + 1);
+        key.append(context);
+        key.push_back('\n');
+        key.append(query);
+        return key;
+    }
+
+    void evict_to(size_t limit) {
+        while (bytes_ > limit && !lru_.empty()) {
+            const EntryPtr& victim = lru_.back();
+            bytes_ -= victim->bytes();
+            map_.erase(make_key(victim->context, victim->query));
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::list<EntryPtr> lru_;
+    std::unordered_map<std::string, typename std::list<EntryPtr>::iterator> map_;
+    size_t budget_;
+    size_t bytes_ = 0;
+    QueryCacheStats stats_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_QUERY_CACHE_H
@@ -0,0 +1,185 @@
+/**
+ * Per-Thread Scratch Arena
+ *
+ * Bump allocator for the temporary buffers of the alignment and pitch
+ * kernels (DP rows, YIN difference functions, converted note sequences).
+ * Every thread owns one arena, reached through ScratchArena::local().
+ *
+ * A public entry point opens a ScratchArena::Scope; kernels allocate from the
+ * arena and never free. When the outermost scope closes the arena is reset,
+ * and if the query needed more than one block the blocks are merged into one
+ * block of the high-water size. After the first few queries every query fits
+ * in that block and the kernels' scratch buffers stop touching the heap.
+ * Results, cache entries and other containers that outlive the scope are
+ * still allocated normally.
+ *
+ * Memory is uninitialized and only suitably aligned for trivial types.
+ */
+
+#ifndef TUNEPAL_CORE_SCRATCH_ARENA_H
+#define TUNEPAL_CORE_SCRATCH_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+namespace tunepal {
+
+class ScratchArena {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    /**
+     * RAII scope: everything allocated inside is released on exit. Closing
+     * the outermost scope resets the arena.
+     */
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena) : arena_(arena), marker_(arena.mark()) { arena_.depth_++; }
+        ~Scope() {
+            arena_.depth_--;
+            if (arena_.depth_ == 0) {
+                arena_.reset();
+            } else {
+                arena_.rewind(marker_);
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ScratchArena& arena_;
+        Marker marker_;
+    };
+
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    ~ScratchArena() {
+        for (Block& block : blocks_) free_block(block);
+    }
+
+    // The calling thread's arena
+    static ScratchArena& local() {
+        static thread_local ScratchArena arena;
+        return arena;
+    }
+
+    /**
+     * Allocate `count` uninitialized elements
+     */
+    template <typename T>
+    T* alloc(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+        static_assert(alignof(T) <= ALIGNMENT, "over-aligned type");
+        return static_cast<T*>(alloc_bytes(count * sizeof(T)));
+    }
+
+    Marker mark() const { return {current_, blocks_.empty() ? 0 : blocks_[current_].used}; }
+
+    void rewind(Marker marker) {
+        if (blocks_.empty()) return;
+        for (size_t i = marker.block + 1; i <= current_ && i < blocks_.size(); i++) blocks_[i].used = 0;
+        current_ = marker.block;
+        blocks_[current_].used = marker.offset;
+    }
+
+    /**
+     * Release everything; merge the blocks if the last query spilled past the first
+     */
+    void reset() {
+        if (blocks_.size() > 1) {
+            size_t total = 0;
+            for (Block& block : blocks_) {
+                total += block.size;
+                free_block(block);
+            }
+            blocks_.clear();
+            add_block(total);
+        }
+        current_ = 0;
+        if (!blocks_.empty()) blocks_[0].used = 0;
+    }
+
+    // Blocks ever allocated by any thread's arena; stays flat once the arenas fit the queries
+    static uint64_t blocks_allocated() { return totals().allocations.load(std::memory_order_relaxed); }
+
+    // Bytes currently held by all arenas
+    static size_t capacity() { return totals().bytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Block {
+        void* raw;
+        uint8_t* data;
+        size_t size;
+        size_t used;
+    };
+
+    void* alloc_bytes(size_t bytes) {
+        bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (bytes == 0) bytes = ALIGNMENT;
+
+        while (!blocks_.empty()) {
+            Block& block = blocks_[current_];
+            if (block.size - block.used >= bytes) {
+                void* result = block.data + block.used;
+                block.used += bytes;
+                return result;
+            }
+            if (current_ + 1 >= blocks_.size()) break;
+            current_++;
+            blocks_[current_].used = 0;
+        }
+
+        size_t size = blocks_.empty() ? MIN_BLOCK_SIZE : blocks_.back().size * 2;
+        while (size < bytes) size *= 2;
+        add_block(size);
+        current_ = blocks_.size() - 1;
+        Block& block = blocks_[current_];
+        block.used = bytes;
+        return block.data;
+    }
+
+    void add_block(size_t size) {
+        // Extensions build without exceptions; fail like operator new would
+        void* raw = std::malloc(size + ALIGNMENT);
+        if (raw == nullptr) std::abort();
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+        blocks_.push_back({raw, reinterpret_cast<uint8_t*>(aligned), size, 0});
+        totals().allocations.fetch_add(1, std::memory_order_relaxed);
+        totals().bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    static void free_block(Block& block) {
+        std::free(block.raw);
+        totals().bytes.fetch_sub(block.size, std::memory_order_relaxed);
+    }
+
+    struct Totals {
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<size_t> bytes{0};
+    };
+
+    static Totals& totals() {
+        static Totals counts;
+        return counts;
+    }
+
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+    int depth_ = 0;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_SCRATCH_ARENA_H
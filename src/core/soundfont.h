@@ -0,0 +1,261 @@
+/**
+ * SoundFont 2 Loading
+ *
+ * Reads an SF2 bank into flat, ready-to-play zones: for every preset the
+ * preset and instrument generator layers are merged once at load time
+ * (instrument values, plus the preset's additive offsets, with key and
+ * velocity ranges intersected), so starting a note is a lookup rather than a
+ * walk over the hydra. Only what the synth uses is kept: sample bounds and
+ * loop points, root key and tuning, attenuation, pan and the volume envelope.
+ * Samples are the 16-bit smpl chunk, copied once.
+ */
+
+#ifndef TUNEPAL_CORE_SOUNDFONT_H
+#define TUNEPAL_CORE_SOUNDFONT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+struct SoundFontZone {
+    uint8_t key_low = 0, key_high = 127;
+    uint8_t velocity_low = 0, velocity_high = 127;
+    uint32_t start = 0, end = 0;             // sample frames in SoundFont::samples()
+    uint32_t loop_start = 0, loop_end = 0;
+    uint32_t sample_rate = 44100;
+    int root_key = 60;
+    int tune_cents = 0;                      // coarse and fine tune plus the sample's correction
+    int loop_mode = 0;                       // 0 none, 1 continuous, 3 until release
+    float attenuation_db = 0.0f;
+    float pan = 0.0f;                        // -1 left .. 1 right
+    float delay = 0.0f, attack = 0.0f, hold = 0.0f, decay = 0.0f, release = 0.0f;   // seconds
+    float sustain = 1.0f;                    // linear level
+};
+
+struct SoundFontPreset {
+    int bank = 0;
+    int program = 0;
+    std::vector<SoundFontZone> zones;
+};
+
+class SoundFont {
+public:
+    /**
+     * Load an SF2 file held in memory
+     * @param error Set to a description of the problem on failure
+     * @return true on success
+     */
+    bool load(const uint8_t* data, size_t size, std::string& error) {
+        presets_.clear();
+        samples_.clear();
+        if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "sfbk", 4) != 0) {
+            error = "not a SoundFont 2 file";
+            return false;
+        }
+
+        Hydra hydra;
+        for (size_t pos = 12; pos + 8 <= size;) {
+            size_t length = std::min<size_t>(u32(data + pos + 4), size - pos - 8);
+            const uint8_t* body = data + pos + 8;
+            if (std::memcmp(data + pos, "LIST", 4) == 0 && length >= 4) {
+                for (size_t sub = 4; sub + 8 <= length;) {
+                    const uint8_t* chunk = body + sub;
+                    size_t chunk_length = std::min<size_t>(u32(chunk + 4), length - sub - 8);
+                    hydra.take(chunk, chunk + 8, chunk_length);
+                    sub += 8 + chunk_length + (chunk_length & 1);
+                }
+            }
+            pos += 8 + length + (length & 1);
+        }
+        if (hydra.samples == nullptr || hydra.phdr == nullptr || hydra.shdr == nullptr) {
+            error = "missing sample data or preset headers";
+            return false;
+        }
+
+        samples_.resize(hydra.sample_bytes / 2);
+        for (size_t i = 0; i < samples_.size(); i++) {
+            samples_[i] = static_cast<int16_t>(hydra.samples[2 * i] | (hydra.samples[2 * i + 1] << 8));
+        }
+
+        // The last record of every hydra list is a terminator
+        size_t preset_count = hydra.phdr_size / 38;
+        for (size_t p = 0; p + 1 < preset_count; p++) {
+            const uint8_t* header = hydra.phdr + p * 38;
+            SoundFontPreset preset;
+            preset.program = u16(header + 20);
+            preset.bank = u16(header + 22);
+            size_t bag_begin = u16(header + 24);
+            size_t bag_end = u16(header + 38 + 24);
+
+            Generators preset_global;
+            for (size_t bag = bag_begin; bag < bag_end; bag++) {
+                Generators zone = preset_global;
+                bool has_instrument = read_generators(hydra.pbag, hydra.pbag_size, hydra.pgen, hydra.pgen_size, bag, zone, INSTRUMENT);
+                if (!has_instrument) {
+                    if (bag == bag_begin) preset_global = zone;
+                    continue;
+                }
+                add_instrument(hydra, zone, preset);
+            }
+            presets_.push_back(preset);
+        }
+        std::sort(presets_.begin(), presets_.end(), [](const SoundFontPreset& a, const SoundFontPreset& b) {
+            return a.bank != b.bank ? a.bank < b.bank : a.program < b.program;
+        });
+        return true;
+    }
+
+    bool empty() const { return presets_.empty(); }
+    const std::vector<int16_t>& samples() const { return samples_; }
+    const std::vector<SoundFontPreset>& presets() const { return presets_; }
+
+    /**
+     * Preset for a bank and program, falling back to the same program in bank
+     * 0 and then to the first preset
+     */
+    const SoundFontPreset* find(int bank, int program) const {
+        if (presets_.empty()) return nullptr;
+        for (int b : {bank, 0}) {
+            for (const SoundFontPreset& preset : presets_) {
+                if (preset.bank == b && preset.program == program) return &preset;
+            }
+        }
+        return &presets_.front();
+    }
+
+private:
+    // Generator operators used here (SF2.04 section 8.1.2)
+    enum {
+        START_OFFSET = 0, END_OFFSET = 1, LOOP_START_OFFSET = 2, LOOP_END_OFFSET = 3,
+        START_COARSE = 4, END_COARSE = 12, PAN = 17,
+        DELAY_VOL = 33, ATTACK_VOL = 34, HOLD_VOL = 35, DECAY_VOL = 36, SUSTAIN_VOL = 37, RELEASE_VOL = 38,
+        INSTRUMENT = 41, KEY_RANGE = 43, VELOCITY_RANGE = 44, LOOP_START_COARSE = 45, ATTENUATION = 48,
+        LOOP_END_COARSE = 50, COARSE_TUNE = 51, FINE_TUNE = 52, SAMPLE_ID = 53, SAMPLE_MODES = 54,
+        ROOT_KEY = 58, GENERATOR_COUNT = 61
+    };
+
+    struct Hydra {
+        const uint8_t* samples = nullptr;
+        size_t sample_bytes = 0;
+        const uint8_t *phdr = nullptr, *pbag = nullptr, *pgen = nullptr, *inst = nullptr, *ibag = nullptr, *igen = nullptr, *shdr = nullptr;
+        size_t phdr_size = 0, pbag_size = 0, pgen_size = 0, inst_size = 0, ibag_size = 0, igen_size = 0, shdr_size = 0;
+
+        void take(const uint8_t* id, const uint8_t* body, size_t length) {
+            struct Slot { const char* id; const uint8_t** data; size_t* size; };
+            const Slot slots[] = {
+                {"smpl", &samples, &sample_bytes}, {"phdr", &phdr, &phdr_size}, {"pbag", &pbag, &pbag_size},
+                {"pgen", &pgen, &pgen_size}, {"inst", &inst, &inst_size}, {"ibag", &ibag, &ibag_size},
+                {"igen", &igen, &igen_size}, {"shdr", &shdr, &shdr_size},
+            };
+            for (const Slot& slot : slots) {
+                if (std::memcmp(id, slot.id, 4) == 0) {
+                    *slot.data = body;
+                    *slot.size = length;
+                }
+            }
+        }
+    };
+
+    // One layer's generator values; `set` marks the ones given explicitly
+    struct Generators {
+        int16_t value[GENERATOR_COUNT];
+        bool set[GENERATOR_COUNT];
+
+        Generators() {
+            std::fill(value, value + GENERATOR_COUNT, int16_t(0));
+            std::fill(set, set + GENERATOR_COUNT, false);
+        }
+        int get(int op, int fallback) const { return set[op] ? value[op] : fallback; }
+    };
+
+    static uint32_t u32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+    static uint16_t u16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+
+    /**
+     * Apply the generators of one bag on top of `out`
+     * @param terminal INSTRUMENT or SAMPLE_ID: the operator that ends a local zone
+     * @return true if the bag has the terminal operator (a local zone)
+     */
+    static bool read_generators(const uint8_t* bags, size_t bags_size, const uint8_t* gens, size_t gens_size,
+                                size_t bag, Generators& out, int terminal) {
+        if (bags == nullptr || gens == nullptr || (bag + 2) * 4 > bags_size) return false;
+        size_t begin = u16(bags + bag * 4);
+        size_t end = std::min<size_t>(u16(bags + (bag + 1) * 4), gens_size / 4);
+        bool local = false;
+        for (size_t g = begin; g < end; g++) {
+            int op = u16(gens + g * 4);
+            if (op >= GENERATOR_COUNT) continue;
+            out.value[op] = static_cast<int16_t>(u16(gens + g * 4 + 2));
+            out.set[op] = true;
+            if (op == terminal) local = true;
+        }
+        return local;
+    }
+
+    static float seconds(int timecents) { return timecents <= -12000 ? 0.0f : std::pow(2.0f, timecents / 1200.0f); }
+
+    // Expand one preset zone into a zone per matching instrument zone
+    void add_instrument(const Hydra& hydra, const Generators& preset_zone, SoundFontPreset& preset) const {
+        size_t instrument = static_cast<uint16_t>(preset_zone.value[INSTRUMENT]);
+        if (hydra.inst == nullptr || (instrument + 2) * 22 > hydra.inst_size) return;
+        size_t bag_begin = u16(hydra.inst + instrument * 22 + 20);
+        size_t bag_end = u16(hydra.inst + (instrument + 1) * 22 + 20);
+
+        Generators global;
+        for (size_t bag = bag_begin; bag < bag_end; bag++) {
+            Generators zone = global;
+            if (!read_generators(hydra.ibag, hydra.ibag_size, hydra.igen, hydra.igen_size, bag, zone, SAMPLE_ID)) {
+                if (bag == bag_begin) global = zone;
+                continue;
+            }
+            size_t sample = static_cast<uint16_t>(zone.value[SAMPLE_ID]);
+            if ((sample + 1) * 46 > hydra.shdr_size) continue;
+            const uint8_t* header = hydra.shdr + sample * 46;
+
+            SoundFontZone out;
+            out.key_low = std::max(zone.get(KEY_RANGE, 0x7F00) & 0xFF, preset_zone.get(KEY_RANGE, 0x7F00) & 0xFF);
+            out.key_high = std::min((zone.get(KEY_RANGE, 0x7F00) >> 8) & 0xFF, (preset_zone.get(KEY_RANGE, 0x7F00) >> 8) & 0xFF);
+            out.velocity_low = std::max(zone.get(VELOCITY_RANGE, 0x7F00) & 0xFF, preset_zone.get(VELOCITY_RANGE, 0x7F00) & 0xFF);
+            out.velocity_high = std::min((zone.get(VELOCITY_RANGE, 0x7F00) >> 8) & 0xFF, (preset_zone.get(VELOCITY_RANGE, 0x7F00) >> 8) & 0xFF);
+            if (out.key_low > out.key_high || out.velocity_low > out.velocity_high) continue;
+
+            // Instrument values plus the preset's offsets
+            auto sum = [&](int op, int fallback) { return zone.get(op, fallback) + preset_zone.get(op, 0); };
+            int64_t total = static_cast<int64_t>(samples_.size());
+            auto clamp_frame = [&](int64_t frame) { return static_cast<uint32_t>(std::max<int64_t>(0, std::min(frame, total))); };
+            out.start = clamp_frame(u32(header + 20) + zone.get(START_OFFSET, 0) + 32768 * zone.get(START_COARSE, 0));
+            out.end = clamp_frame(u32(header + 24) + zone.get(END_OFFSET, 0) + 32768 * zone.get(END_COARSE, 0));
+            out.loop_start = clamp_frame(u32(header + 28) + zone.get(LOOP_START_OFFSET, 0) + 32768 * zone.get(LOOP_START_COARSE, 0));
+            out.loop_end = clamp_frame(u32(header + 32) + zone.get(LOOP_END_OFFSET, 0) + 32768 * zone.get(LOOP_END_COARSE, 0));
+            if (out.end <= out.start) continue;
+            out.sample_rate = std::max<uint32_t>(u32(header + 36), 1);
+            int original_pitch = header[40];
+            out.root_key = zone.get(ROOT_KEY, -1) >= 0 ? zone.get(ROOT_KEY, -1) : (original_pitch <= 127 ? original_pitch : 60);
+            out.tune_cents = 100 * sum(COARSE_TUNE, 0) + sum(FINE_TUNE, 0) + static_cast<int8_t>(header[41]);
+            out.loop_mode = zone.get(SAMPLE_MODES, 0) & 3;
+            if (out.loop_end <= out.loop_start) out.loop_mode = 0;
+            out.attenuation_db = std::max(sum(ATTENUATION, 0), 0) / 10.0f;
+            out.pan = std::max(-1.0f, std::min(1.0f, sum(PAN, 0) / 500.0f));
+            out.delay = seconds(sum(DELAY_VOL, -12000));
+            out.attack = seconds(sum(ATTACK_VOL, -12000));
+            out.hold = seconds(sum(HOLD_VOL, -12000));
+            out.decay = seconds(sum(DECAY_VOL, -12000));
+            out.release = seconds(sum(RELEASE_VOL, -12000));
+            out.sustain = std::pow(10.0f, -std::max(0, std::min(sum(SUSTAIN_VOL, 0), 1440)) / 200.0f);
+            preset.zones.push_back(out);
+        }
+    }
+
+    std::vector<SoundFontPreset> presets_;
+    std::vector<int16_t> samples_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_SOUNDFONT_H
@@ -0,0 +1,417 @@
+/**
+ * MIDI Synthesizer
+ *
+ * A small SoundFont voice mixer for playing tunes back:
+ *   - Synth: sixteen MIDI channels (program, bank, volume, expression, pan,
+ *     sustain pedal, pitch bend) driving a fixed pool of voices. Each voice
+ *     plays one SoundFontZone with linear interpolation, loop modes and the
+ *     DAHDSR volume envelope. When no SoundFont is loaded a built-in
+ *     harmonic tone is used instead, so tunes still play. At the polyphony
+ *     limit the quietest releasing voice (or else the oldest) is stolen.
+ *   - MidiSequencer: walks a MidiSong and splits every render call at event
+ *     frames, so each event takes effect on its exact sample regardless of
+ *     the audio block size.
+ * Output is interleaved stereo float.
+ */
+
+#ifndef TUNEPAL_CORE_SYNTH_H
+#define TUNEPAL_CORE_SYNTH_H
+
+#include "midi_file.h"
+#include "soundfont.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunepal {
+
+class Synth {
+public:
+    static const int CHANNELS = 16;
+    static const int DRUM_CHANNEL = 9;
+
+    explicit Synth(double sample_rate = 44100.0, int max_voices = 64) { configure(sample_rate, max_voices); }
+
+    void configure(double sample_rate, int max_voices) {
+        sample_rate_ = sample_rate > 0.0 ? sample_rate : 44100.0;
+        voices_.assign(std::max(max_voices, 1), Voice());
+        reset();
+    }
+
+    // The font must outlive the synth or the next set_soundfont call; null plays the built-in tone
+    void set_soundfont(const SoundFont* font) {
+        font_ = font != nullptr && !font->empty() ? font : nullptr;
+        reset();
+    }
+
+    void reset() {
+        for (Voice& voice : voices_) voice.stage = OFF;
+        for (Channel& channel : channels_) channel = Channel();
+        clock_ = 0;
+    }
+
+    double sample_rate() const { return sample_rate_; }
+    int max_voices() const { return static_cast<int>(voices_.size()); }
+
+    int active_voices() const {
+        int active = 0;
+        for (const Voice& voice : voices_) active += voice.stage != OFF;
+        return active;
+    }
+
+    // Apply one channel message
+    void handle(uint8_t status, uint8_t data1, uint8_t data2) {
+        Channel& channel = channels_[status & 0x0F];
+        int number = status & 0x0F;
+        switch (status & 0xF0) {
+        case 0x80:
+            note_off(number, data1);
+            break;
+        case 0x90:
+            // Velocity 0 is a note-off
+            if (data2 > 0) {
+                note_on(number, data1, data2);
+            } else {
+                note_off(number, data1);
+            }
+            break;
+        case 0xB0:
+            control_change(number, data1, data2);
+            break;
+        case 0xC0:
+            channel.program = data1;
+            break;
+        case 0xE0:
+            channel.bend = ((data2 << 7 | data1) - 8192) / 8192.0f * channel.bend_range;
+            for (Voice& voice : voices_) {
+                if (voice.stage != OFF && voice.channel == number) voice.step = voice.base_step * std::pow(2.0, channel.bend / 12.0);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void handle(const MidiEvent& event) { handle(event.status, event.data1, event.data2); }
+
+    /**
+     * Mix every active voice into `frames` stereo frames
+     * @param out 2 * frames floats, overwritten
+     */
+    void render(float* out, int frames) {
+        std::fill(out, out + 2 * frames, 0.0f);
+        for (Voice& voice : voices_) {
+            if (voice.stage == OFF) continue;
+            const Channel& channel = channels_[voice.channel];
+            float gain = voice.gain * channel.volume * channel.volume * channel.expression;
+            float pan = std::max(-1.0f, std::min(1.0f, voice.pan + channel.pan));
+            float left = gain * std::sqrt(0.5f * (1.0f - pan));
+            float right = gain * std::sqrt(0.5f * (1.0f + pan));
+            if (voice.zone != nullptr) {
+                render_sample(voice, out, frames, left, right);
+            } else {
+                render_tone(voice, out, frames, left, right);
+            }
+        }
+        clock_ += frames;
+    }
+
+private:
+    enum Stage { DELAY, ATTACK, HOLD, DECAY, SUSTAIN, RELEASE, OFF };
+
+    struct Channel {
+        int program = 0;
+        int bank = 0;
+        float volume = 100.0f / 127.0f;
+        float expression = 1.0f;
+        float pan = 0.0f;
+        bool sustain = false;
+        float bend = 0.0f;         // semitones
+        float bend_range = 2.0f;
+    };
+
+    struct Voice {
+        Stage stage = OFF;
+        uint8_t channel = 0;
+        uint8_t key = 0;
+        bool held = false;         // note-off arrived while the sustain pedal was down
+        uint64_t started = 0;
+        const SoundFontZone* zone = nullptr;
+        double position = 0.0;     // sample frame, or oscillator phase for the built-in tone
+        double step = 0.0;
+        double base_step = 0.0;    // step before pitch bend
+        float gain = 0.0f;
+        float pan = 0.0f;
+        float level = 0.0f;        // envelope
+        int64_t stage_frames = 0;  // frames left in a timed stage
+        int64_t hold_frames = 0;
+        float attack_step = 1.0f;
+        float decay_factor = 0.0f;
+        float release_factor = 0.0f;
+        float sustain = 1.0f;
+    };
+
+    // Per-frame factor that takes the envelope 96 dB down in `seconds`
+    float fall_factor(float seconds) const {
+        double frames = std::max(seconds * sample_rate_, 1.0);
+        return static_cast<float>(std::pow(10.0, -96.0 / 20.0 / frames));
+    }
+
+    void note_on(int number, uint8_t key, uint8_t velocity) {
+        Channel& channel = channels_[number];
+        note_off(number, key, true);   // retrigger
+
+        const SoundFontZone* zones[8];
+        int zone_count = 0;
+        if (font_ != nullptr) {
+            const SoundFontPreset* preset = font_->find(number == DRUM_CHANNEL ? 128 : channel.bank, channel.program);
+            for (size_t z = 0; preset != nullptr && z < preset->zones.size() && zone_count < 8; z++) {
+                const SoundFontZone& zone = preset->zones[z];
+                if (key >= zone.key_low && key <= zone.key_high && velocity >= zone.velocity_low && velocity <= zone.velocity_high) {
+                    zones[zone_count++] = &zone;
+                }
+            }
+            if (zone_count == 0) return;
+        } else {
+            zones[zone_count++] = nullptr;
+        }
+
+        float velocity_gain = (velocity / 127.0f) * (velocity / 127.0f);
+        for (int z = 0; z < zone_count; z++) {
+            Voice& voice = allocate();
+            const SoundFontZone* zone = zones[z];
+            voice = Voice();
+            voice.channel = static_cast<uint8_t>(number);
+            voice.key = key;
+            voice.started = clock_;
+            voice.zone = zone;
+            if (zone != nullptr) {
+                double cents = (key - zone->root_key) * 100.0 + zone->tune_cents;
+                voice.base_step = std::pow(2.0, cents / 1200.0) * zone->sample_rate / sample_rate_;
+                voice.position = zone->start;
+                voice.gain = velocity_gain * static_cast<float>(std::pow(10.0, -zone->attenuation_db / 20.0));
+                voice.pan = zone->pan;
+                start_envelope(voice, zone->delay, zone->attack, zone->hold, zone->decay, zone->sustain, zone->release);
+            } else {
+                voice.base_step = 440.0 * std::pow(2.0, (key - 69) / 12.0) / sample_rate_;
+                voice.gain = 0.5f * velocity_gain;
+                start_envelope(voice, 0.0f, 0.005f, 0.0f, 0.6f, 0.4f, 0.12f);
+            }
+            voice.step = voice.base_step * std::pow(2.0, channel.bend / 12.0);
+        }
+    }
+
+    void start_envelope(Voice& voice, float delay, float attack, float hold, float decay, float sustain, float release) {
+        voice.stage = DELAY;
+        voice.stage_frames = static_cast<int64_t>(delay * sample_rate_);
+        voice.attack_step = 1.0f / static_cast<float>(std::max(attack * sample_rate_, 1.0));
+        voice.decay_factor = fall_factor(decay);
+        voice.release_factor = fall_factor(release);
+        voice.sustain = sustain;
+        voice.level = 0.0f;
+        voice.held = false;
+        voice.hold_frames = static_cast<int64_t>(hold * sample_rate_);
+    }
+
+    void note_off(int number, uint8_t key, bool force = false) {
+        for (Voice& voice : voices_) {
+            if (voice.stage == OFF || voice.stage == RELEASE || voice.channel != number || voice.key != key) continue;
+            if (channels_[number].sustain && !force) {
+                voice.held = true;
+            } else {
+                voice.stage = RELEASE;
+            }
+        }
+    }
+
+    void control_change(int number, uint8_t controller, uint8_t value) {
+        Channel& channel = channels_[number];
+        switch (controller) {
+        case 0: channel.bank = value; break;
+        case 7: channel.volume = value / 127.0f; break;
+        case 10: channel.pan = (value - 64) / 64.0f; break;
+        case 11: channel.expression = value / 127.0f; break;
+        case 64:
+            channel.sustain = value >= 64;
+            if (!channel.sustain) {
+                for (Voice& voice : voices_) {
+                    if (voice.stage != OFF && voice.channel == number && voice.held) voice.stage = RELEASE;
+                }
+            }
+            break;
+        case 120:   // all sound off
+            for (Voice& voice : voices_) {
+                if (voice.channel == number) voice.stage = OFF;
+            }
+            break;
+        case 121:   // reset controllers
+            channel.expression = 1.0f;
+            channel.sustain = false;
+            channel.bend = 0.0f;
+            break;
+        case 123:   // all notes off
+            for (Voice& voice : voices_) {
+                if (voice.stage != OFF && voice.stage != RELEASE && voice.channel == number) voice.stage = RELEASE;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // A free voice, or the one least missed: the quietest releasing voice, else the oldest
+    Voice& allocate() {
+        Voice* best = nullptr;
+        for (Voice& voice : voices_) {
+            if (voice.stage == OFF) return voice;
+            if (best == nullptr) {
+                best = &voice;
+            } else if ((voice.stage == RELEASE) != (best->stage == RELEASE)) {
+                if (voice.stage == RELEASE) best = &voice;
+            } else if (voice.stage == RELEASE ? voice.level < best->level : voice.started < best->started) {
+                best = &voice;
+            }
+        }
+        return *best;
+    }
+
+    // Advance the envelope one frame; false once the voice has died away
+    bool envelope(Voice& voice) {
+        switch (voice.stage) {
+        case DELAY:
+            if (voice.stage_frames-- > 0) return true;
+            voice.stage = ATTACK;
+            // fall through
+        case ATTACK:
+            voice.level += voice.attack_step;
+            if (voice.level >= 1.0f) {
+                voice.level = 1.0f;
+                voice.stage = HOLD;
+                voice.stage_frames = voice.hold_frames;
+            }
+            return true;
+        case HOLD:
+            if (voice.stage_frames-- > 0) return true;
+            voice.stage = DECAY;
+            // fall through
+        case DECAY:
+            voice.level *= voice.decay_factor;
+            if (voice.level <= 1e-4f && voice.sustain <= 1e-4f) return false;
+            if (voice.level <= voice.sustain) {
+                voice.level = voice.sustain;
+                voice.stage = SUSTAIN;
+            }
+            return true;
+        case SUSTAIN:
+            return voice.level > 0.0f;
+        case RELEASE:
+            voice.level *= voice.release_factor;
+            return voice.level > 1e-4f;
+        default:
+            return false;
+        }
+    }
+
+    void render_sample(Voice& voice, float* out, int frames, float left, float right) {
+        const SoundFontZone& zone = *voice.zone;
+        const int16_t* samples = font_->samples().data();
+        double loop_length = static_cast<double>(zone.loop_end) - zone.loop_start;
+        for (int i = 0; i < frames; i++) {
+            if (!envelope(voice)) {
+                voice.stage = OFF;
+                return;
+            }
+            bool looping = zone.loop_mode == 1 || (zone.loop_mode == 3 && voice.stage != RELEASE);
+            if (looping) {
+                while (voice.position >= zone.loop_end) voice.position -= loop_length;
+            } else if (voice.position >= zone.end - 1) {
+                voice.stage = OFF;
+                return;
+            }
+            uint32_t index = static_cast<uint32_t>(voice.position);
+            float frac = static_cast<float>(voice.position - index);
+            uint32_t next = index + 1;
+            if (looping && next >= zone.loop_end) next = zone.loop_start;
+            float value = (samples[index] + (samples[next] - samples[index]) * frac) * (voice.level / 32768.0f);
+            out[2 * i] += value * left;
+            out[2 * i + 1] += value * right;
+            voice.position += voice.step;
+        }
+    }
+
+    // Built-in instrument: fundamental plus two softer harmonics
+    void render_tone(Voice& voice, float* out, int frames, float left, float right) {
+        const double two_pi = 6.283185307179586;
+        for (int i = 0; i < frames; i++) {
+            if (!envelope(voice)) {
+                voice.stage = OFF;
+                return;
+            }
+            double phase = two_pi * voice.position;
+            float value = static_cast<float>(std::sin(phase) + 0.5 * std::sin(2.0 * phase) + 0.25 * std::sin(3.0 * phase)) * (voice.level / 1.75f);
+            out[2 * i] += value * left;
+            out[2 * i + 1] += value * right;
+            voice.position += voice.step;
+            if (voice.position >= 1.0) voice.position -= 1.0;
+        }
+    }
+
+    double sample_rate_ = 44100.0;
+    const SoundFont* font_ = nullptr;
+    Channel channels_[CHANNELS];
+    std::vector<Voice> voices_;
+    uint64_t clock_ = 0;   // frames rendered, orders voices by age
+};
+
+/**
+ * Plays a MidiSong through a Synth. Every render call is split at the event
+ * frames it spans, so events land on their exact sample whatever the block
+ * size.
+ */
+class MidiSequencer {
+public:
+    void load(const MidiSong& song) {
+        song_ = song;
+        rewind();
+    }
+
+    void rewind() {
+        next_ = 0;
+        cursor_ = 0;
+    }
+
+    const MidiSong& song() const { return song_; }
+    uint64_t position() const { return cursor_; }
+
+    // All events applied (voices may still be releasing)
+    bool finished() const { return next_ >= song_.events.size(); }
+
+    /**
+     * Render the next `frames` frames of the song
+     * @param out 2 * frames floats of interleaved stereo, overwritten
+     */
+    void render(Synth& synth, float* out, int frames) {
+        int done = 0;
+        while (done < frames) {
+            uint64_t now = cursor_ + done;
+            while (next_ < song_.events.size() && song_.events[next_].frame <= now) synth.handle(song_.events[next_++]);
+            int span = frames - done;
+            if (next_ < song_.events.size()) span = static_cast<int>(std::min<uint64_t>(span, song_.events[next_].frame - now));
+            synth.render(out + 2 * done, span);
+            done += span;
+        }
+        cursor_ += frames;
+    }
+
+private:
+    MidiSong song_;
+    size_t next_ = 0;
+    uint64_t cursor_ = 0;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_SYNTH_H
@@ -0,0 +1,197 @@
+/**
+ * Span Tracing
+ *
+ * Opt-in timeline of where time goes across threads, for finding stragglers
+ * and load imbalance that averaged timings hide. A TraceSpan records one
+ * begin/end pair into its thread's buffer; Trace::chrome_json() writes every
+ * buffer as Chrome trace-event JSON, which Perfetto (ui.perfetto.dev) and
+ * chrome://tracing open directly.
+ *
+ * Recording takes no locks: each thread appends to its own fixed-size buffer
+ * and publishes the count with a release store. A thread's buffer is made the
+ * first time it records, so threads never traced cost no memory. When tracing
+ * is off a span costs one relaxed load and a branch.
+ *
+ * Span names must be string literals (they are stored by pointer). Clear and
+ * dump while no traced work is running.
+ */
+
+#ifndef TUNEPAL_CORE_TRACE_H
+#define TUNEPAL_CORE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+class Trace {
+public:
+    static constexpr uint32_t BUFFER_EVENTS = 16384;   // per thread; later spans are dropped
+
+    struct Event {
+        const char* name;
+        int64_t arg;        // shown as args.n; -1 for none
+        uint64_t begin_ns;
+        uint64_t end_ns;
+    };
+
+    static bool enabled() { return flag().load(std::memory_order_relaxed); }
+    static void set_enabled(bool on) { flag().store(on, std::memory_order_relaxed); }
+
+    // Label this thread's events as pool worker `worker` (see core/parallel.h)
+    static void set_worker(int worker) { worker_index() = worker; }
+
+    static uint64_t now_ns() {
+        static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - origin).count());
+    }
+
+    static void record(const char* name, uint64_t begin_ns, uint64_t end_ns, int64_t arg) {
+        Buffer* buffer = local();
+        uint32_t count = buffer->count.load(std::memory_order_relaxed);
+        if (count >= BUFFER_EVENTS) {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Event& event = buffer->events[count];
+        event.name = name;
+        event.arg = arg;
+        event.begin_ns = begin_ns;
+        event.end_ns = end_ns;
+        buffer->count.store(count + 1, std::memory_order_release);
+    }
+
+    // Events recorded by all threads, and spans dropped from full buffers
+    static size_t event_count(size_t* dropped = nullptr) {
+        Registry& registry = registry_instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        size_t total = 0;
+        size_t lost = 0;
+        for (const std::unique_ptr<Buffer>& buffer : registry.buffers) {
+            total += buffer->count.load(std::memory_order_acquire);
+            lost += buffer->dropped.load(std::memory_order_relaxed);
+        }
+        if (dropped) *dropped = lost;
+        return total;
+    }
+
+    static void clear() {
+        Registry& registry = registry_instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const std::unique_ptr<Buffer>& buffer : registry.buffers) {
+            buffer->count.store(0, std::memory_order_release);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Every recorded span as a Chrome trace-event document: one complete
+     * ("X") event per span, in microseconds, plus a name for each thread
+     * @param process_name Shown as the process in the viewer
+     */
+    static std::string chrome_json(const char* process_name) {
+        Registry& registry = registry_instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        char line[256];
+        std::snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", process_name);
+        json += line;
+        for (const std::unique_ptr<Buffer>& buffer : registry.buffers) {
+            std::snprintf(line, sizeof(line), ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                          buffer->tid, buffer->label.c_str());
+            json += line;
+            uint32_t count = buffer->count.load(std::memory_order_acquire);
+            for (uint32_t e = 0; e < count; e++) {
+                const Event& event = buffer->events[e];
+                std::snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                              event.name, buffer->tid, event.begin_ns / 1000.0, (event.end_ns - event.begin_ns) / 1000.0);
+                json += line;
+                if (event.arg >= 0) {
+                    std::snprintf(line, sizeof(line), ",\"args\":{\"n\":%lld}", static_cast<long long>(event.arg));
+                    json += line;
+                }
+                json += '}';
+            }
+        }
+        json += "]}";
+        return json;
+    }
+
+private:
+    struct Buffer {
+        std::unique_ptr<Event[]> events{new Event[BUFFER_EVENTS]};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> dropped{0};
+        uint32_t tid = 0;
+        std::string label;
+    };
+
+    // Buffers outlive their threads, so a dump still sees short-lived ones
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Buffer>> buffers;
+    };
+
+    static std::atomic<bool>& flag() {
+        static std::atomic<bool> on{false};
+        return on;
+    }
+
+    static int& worker_index() {
+        static thread_local int worker = -1;
+        return worker;
+    }
+
+    static Registry& registry_instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    static Buffer* local() {
+        static thread_local Buffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            Registry& registry = registry_instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.buffers.emplace_back(new Buffer());
+            buffer = registry.buffers.back().get();
+            buffer->tid = static_cast<uint32_t>(registry.buffers.size());
+            int worker = worker_index();
+            buffer->label = worker >= 0 ? "worker " + std::to_string(worker) : "thread " + std::to_string(buffer->tid);
+        }
+        return buffer;
+    }
+};
+
+/**
+ * Records the enclosing scope as one span while tracing is on
+ * @param name String literal shown in the viewer
+ * @param arg Optional count shown with the span (e.g. tunes in a chunk)
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, int64_t arg = -1) : name_(name), arg_(arg), begin_ns_(0), active_(Trace::enabled()) {
+        if (active_) begin_ns_ = Trace::now_ns();
+    }
+    ~TraceSpan() {
+        if (active_) Trace::record(name_, begin_ns_, Trace::now_ns(), arg_);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    int64_t arg_;
+    uint64_t begin_ns_;
+    bool active_;
+};
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_TRACE_H
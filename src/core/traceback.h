@@ -0,0 +1,153 @@
+/**
+ * Linear-Space Alignment Traceback
+ *
+ * Aligner only keeps one DP row, so it can say how far a query is from a
+ * tune but not where in the tune it matched. Keeping every row for a
+ * traceback would need pattern x key cells per tune; instead, for the few
+ * results that are shown, the match is recovered in linear space:
+ *
+ *   1. a forward pass over the key finds the column the best match ends in,
+ *   2. a pass over the reversed pattern and key prefix finds where it starts,
+ *   3. Hirschberg's divide and conquer aligns the pattern with that span,
+ *      splitting the pattern in half and finding the key column the optimal
+ *      path crosses from one forward and one reverse row, then recursing.
+ *
+ * Every row is computed by Aligner itself (SubstringBoundary for the end
+ * column, GlobalBoundary otherwise), reading reversed copies of the
+ * sequences for the backward passes, so the distance always equals the
+ * matching Aligner's. Memory is a few rows and copies of the key length
+ * (from the scratch arena) and time about three times one alignment.
+ *
+ * Operations are written one per step, CIGAR style:
+ *   '='  query note matches the key
+ *   'X'  query note substituted for a key note
+ *   'I'  query note with no key note (played extra)
+ *   'D'  key note with no query note (missed)
+ */
+
+#ifndef TUNEPAL_CORE_TRACEBACK_H
+#define TUNEPAL_CORE_TRACEBACK_H
+
+#include "alignment.h"
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <string>
+
+namespace tunepal {
+
+struct AlignmentMatch {
+    int distance = 0;
+    int start = 0;       // first key symbol of the match
+    int end = 0;         // one past the last key symbol
+    std::string ops;
+};
+
+template <typename Cost>
+struct Traceback {
+    typedef typename Cost::Cell Score;
+
+    /**
+     * Best substring match of the pattern in the text, with its operations
+     * @return Earliest-ending best match, and the shortest one ending there
+     */
+    template <typename P, typename T>
+    static AlignmentMatch locate(const P* pattern, int pattern_length, const T* text, int text_length) {
+        AlignmentMatch match;
+        ScratchArena& arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        Score* row = arena.alloc<Score>(text_length + 1);
+
+        // 1. End column: free start in the key
+        last_row<SubstringBoundary>(pattern, pattern_length, text, text_length, row);
+        match.end = static_cast<int>(std::min_element(row, row + text_length + 1) - row);
+        match.distance = static_cast<int>(row[match.end]);
+
+        // 2. Start column: the reversed pattern must start at the end column
+        //    and may stop anywhere before it
+        last_row<GlobalBoundary>(reversed(arena, pattern, pattern_length), pattern_length,
+                                 reversed(arena, text, match.end), match.end, row);
+        int span = static_cast<int>(std::min_element(row, row + match.end + 1) - row);
+        match.start = match.end - span;
+
+        // 3. Operations over that span
+        match.ops.reserve(pattern_length + span);
+        hirschberg(pattern, pattern_length, text + match.start, span, match.ops);
+        return match;
+    }
+
+private:
+    /**
+     * Last DP row of aligning a with b
+     * @param row Receives b_length + 1 cells
+     */
+    template <typename Boundary, typename P, typename T>
+    static void last_row(const P* a, int a_length, const T* b, int b_length, Score* row) {
+        Aligner<Cost, Boundary>::init_row(row, b_length);
+        Aligner<Cost, Boundary>::advance(row, 0, a, a_length, b, b_length);
+    }
+
+    // Back-to-front copy of a sequence, valid until the arena scope closes
+    template <typename S>
+    static const S* reversed(ScratchArena& arena, const S* sequence, int length) {
+        S* copy = arena.alloc<S>(length);
+        std::reverse_copy(sequence, sequence + length, copy);
+        return copy;
+    }
+
+    // Global alignment of a with b, appending its operations
+    template <typename P, typename T>
+    static void hirschberg(const P* a, int a_length, const T* b, int b_length, std::string& ops) {
+        if (a_length == 0) {
+            ops.append(b_length, 'D');
+            return;
+        }
+        if (b_length == 0) {
+            ops.append(a_length, 'I');
+            return;
+        }
+        if (a_length == 1) {
+            // Match the note where the key has it, otherwise substitute the first
+            int j = 0;
+            while (j < b_length && Cost::substitution(a[0], b[j]) != 0) j++;
+            if (j == b_length) {
+                ops.push_back('X');
+                ops.append(b_length - 1, 'D');
+            } else {
+                ops.append(j, 'D');
+                ops.push_back('=');
+                ops.append(b_length - 1 - j, 'D');
+            }
+            return;
+        }
+
+        int middle = a_length / 2;
+        int split = 0;
+        {
+            ScratchArena& arena = ScratchArena::local();
+            ScratchArena::Scope scope(arena);
+            Score* forward = arena.alloc<Score>(b_length + 1);
+            Score* backward = arena.alloc<Score>(b_length + 1);
+            last_row<GlobalBoundary>(a, middle, b, b_length, forward);
+            last_row<GlobalBoundary>(reversed(arena, a + middle, a_length - middle), a_length - middle,
+                                     reversed(arena, b, b_length), b_length, backward);
+            Score best = forward[0] + backward[b_length];
+            for (int j = 1; j <= b_length; j++) {
+                Score cost = forward[j] + backward[b_length - j];
+                if (cost < best) {
+                    best = cost;
+                    split = j;
+                }
+            }
+        }
+        hirschberg(a, middle, b, split, ops);
+        hirschberg(a + middle, a_length - middle, b + split, b_length - split, ops);
+    }
+};
+
+// Traceback for Tunepal::edSubstring and the searches built on it
+typedef Traceback<WildcardEditCost> EdSubstringTraceback;
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_TRACEBACK_H
@@ -0,0 +1,123 @@
+/**
+ * WAV Decoding
+ *
+ * Reads RIFF/WAVE files (8/16/24/32-bit integer PCM and 32-bit float) into
+ * mono float samples, for replaying recorded fixtures through the native
+ * pipeline. Channels are averaged.
+ */
+
+#ifndef TUNEPAL_CORE_WAV_H
+#define TUNEPAL_CORE_WAV_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace tunepal {
+
+struct WavAudio {
+    double sample_rate = 0.0;
+    int channels = 0;
+    std::vector<float> samples;   // mono
+
+    double seconds() const { return sample_rate > 0.0 ? samples.size() / sample_rate : 0.0; }
+};
+
+/**
+ * Decode a WAV file held in memory
+ * @param data File contents
+ * @param size Size in bytes
+ * @param out Decoded audio
+ * @param error Set to a description of the problem on failure
+ * @return true on success
+ */
+inline bool decode_wav(const uint8_t* data, size_t size, WavAudio& out, std::string& error) {
+    struct Reader {
+        static uint32_t u32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+        static uint16_t u16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    };
+
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        error = "not a RIFF/WAVE file";
+        return false;
+    }
+
+    const int FORMAT_PCM = 1;
+    const int FORMAT_FLOAT = 3;
+    const int FORMAT_EXTENSIBLE = 0xFFFE;
+    int format = 0;
+    int channels = 0;
+    int bits = 0;
+    uint32_t rate = 0;
+    const uint8_t* samples = nullptr;
+    size_t sample_bytes = 0;
+
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const uint8_t* chunk = data + pos;
+        size_t length = Reader::u32(chunk + 4);
+        size_t available = size - pos - 8;
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && length >= 16 && length <= available) {
+            format = Reader::u16(chunk + 8);
+            channels = Reader::u16(chunk + 10);
+            rate = Reader::u32(chunk + 12);
+            bits = Reader::u16(chunk + 22);
+            // The real format code is the first two bytes of the sub-format GUID
+            if (format == FORMAT_EXTENSIBLE && length >= 26) format = Reader::u16(chunk + 32);
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            samples = chunk + 8;
+            sample_bytes = length < available ? length : available;   // tolerate truncated files
+        }
+        pos += 8 + length + (length & 1);
+    }
+
+    if (channels <= 0 || rate == 0) {
+        error = "missing or invalid fmt chunk";
+        return false;
+    }
+    if (samples == nullptr) {
+        error = "missing data chunk";
+        return false;
+    }
+    bool supported = (format == FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32))
+            || (format == FORMAT_FLOAT && bits == 32);
+    if (!supported) {
+        error = "unsupported sample format " + std::to_string(format) + "/" + std::to_string(bits) + " bit";
+        return false;
+    }
+
+    size_t width = static_cast<size_t>(bits / 8);
+    size_t frames = sample_bytes / (width * channels);
+    out.sample_rate = rate;
+    out.channels = channels;
+    out.samples.resize(frames);
+
+    const uint8_t* p = samples;
+    for (size_t f = 0; f < frames; f++) {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; c++, p += width) {
+            if (format == FORMAT_FLOAT) {
+                float v;
+                std::memcpy(&v, p, 4);
+                sum += v;
+            } else if (bits == 8) {
+                sum += (static_cast<int>(p[0]) - 128) / 128.0f;
+            } else if (bits == 16) {
+                sum += static_cast<int16_t>(Reader::u16(p)) / 32768.0f;
+            } else if (bits == 24) {
+                int32_t v = static_cast<int32_t>((p[0] << 8) | (p[1] << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+                sum += v / 8388608.0f;
+            } else {
+                sum += static_cast<int32_t>(Reader::u32(p)) / 2147483648.0f;
+            }
+        }
+        out.samples[f] = sum / channels;
+    }
+    return true;
+}
+
+} // namespace tunepal
+
+#endif // TUNEPAL_CORE_WAV_H
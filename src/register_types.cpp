@@ -1,6 +1,7 @@
 #include "register_types.h"
 
 #include "tunepal.h"
+#include "tunepal_midi.h"
 
 #include <gdextension_interface.h>
 #include <godot_cpp/core/defs.hpp>
@@ -14,6 +15,7 @@ void initialize_example_module(ModuleInitializationLevel p_level) {
 	}
 
 	ClassDB::register_class<Tunepal>();
+	ClassDB::register_class<TunepalMidi>();
 }
 
 void uninitialize_example_module(ModuleInitializationLevel p_level) {
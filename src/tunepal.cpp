@@ -1,15 +1,104 @@
 #include "tunepal.h"
+#include "core/abc_indexer.h"
+#include "core/alignment.h"
+#include "core/batch_scoring.h"
+#include "core/parallel.h"
+#include "core/scratch_arena.h"
+#include "core/trace.h"
+#include "core/traceback.h"
+#include "core/wav.h"
+#include <godot_cpp/classes/class_db_singleton.hpp>
+#include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
 #include<string>
 #include<ios>
+#include<algorithm>
+#include<vector>
+#include<chrono>
+#include<cmath>
 
 using namespace godot;
 using namespace std;
 
+// Smallest share of a scan worth its own worker, in DP cells
+static const size_t MIN_CHUNK_CELLS = 256 * 1024;
+
+// Normalize the same way for lookups and scoring: upper case, no whitespace
+static std::string normalize_query(const godot::String &query)
+{
+	std::string pattern;
+	godot::CharString raw = query.to_upper().utf8();
+	for (int i = 0; i < raw.length(); i++)
+	{
+		char c = raw.get_data()[i];
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+		{
+			pattern.push_back(c);
+		}
+	}
+	return pattern;
+}
+
 void Tunepal::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("say_hello"), &Tunepal::say_hello);
 	ClassDB::bind_method(D_METHOD("edSubstring"), &Tunepal::edSubstring);
+
+	ClassDB::bind_method(D_METHOD("clear_corpus"), &Tunepal::clear_corpus);
+	ClassDB::bind_method(D_METHOD("add_tune", "id", "search_key", "time_sig"), &Tunepal::add_tune);
+	ClassDB::bind_method(D_METHOD("add_tunes", "ids", "search_keys", "time_sigs"), &Tunepal::add_tunes);
+	ClassDB::bind_method(D_METHOD("get_corpus_size"), &Tunepal::get_corpus_size);
+	ClassDB::bind_method(D_METHOD("set_min_key_length", "length"), &Tunepal::set_min_key_length);
+	ClassDB::bind_method(D_METHOD("get_min_key_length"), &Tunepal::get_min_key_length);
+	ClassDB::bind_method(D_METHOD("get_length_buckets"), &Tunepal::get_length_buckets);
+	ClassDB::bind_method(D_METHOD("load_corpus", "path", "source", "page_size"), &Tunepal::load_corpus, DEFVAL(2000));
+	ClassDB::bind_method(D_METHOD("is_corpus_loading"), &Tunepal::is_corpus_loading);
+	ClassDB::bind_method(D_METHOD("get_tune_rows"), &Tunepal::get_tune_rows);
+	ClassDB::bind_method(D_METHOD("fetch_tune", "index"), &Tunepal::fetch_tune);
+	ClassDB::bind_method(D_METHOD("_apply_loaded_pages"), &Tunepal::_apply_loaded_pages);
+	ClassDB::bind_method(D_METHOD("index_abc", "notation"), &Tunepal::index_abc);
+	ClassDB::bind_method(D_METHOD("add_abc_tune", "id", "notation", "time_sig"), &Tunepal::add_abc_tune, DEFVAL(""));
+	ClassDB::bind_method(D_METHOD("reindex_notation", "path", "source"), &Tunepal::reindex_notation);
+	ClassDB::bind_method(D_METHOD("locate_in_notation", "notation", "start", "end"), &Tunepal::locate_in_notation);
+	ADD_SIGNAL(MethodInfo("corpus_progress", PropertyInfo(Variant::INT, "loaded"), PropertyInfo(Variant::INT, "total")));
+	ADD_SIGNAL(MethodInfo("corpus_ready", PropertyInfo(Variant::INT, "count")));
+	ClassDB::bind_method(D_METHOD("set_coarse_candidates", "count"), &Tunepal::set_coarse_candidates);
+	ClassDB::bind_method(D_METHOD("get_coarse_candidates"), &Tunepal::get_coarse_candidates);
+	ClassDB::bind_method(D_METHOD("coarse_rank", "query", "count"), &Tunepal::coarse_rank);
+	ClassDB::bind_method(D_METHOD("measure_coarse_recall", "queries", "count", "top_k"), &Tunepal::measure_coarse_recall, DEFVAL(10));
+
+	ClassDB::bind_method(D_METHOD("search", "query", "max_results", "time_sigs"), &Tunepal::search, DEFVAL(PackedStringArray()));
+	ClassDB::bind_method(D_METHOD("search_batch", "queries", "max_results", "time_sigs"), &Tunepal::search_batch, DEFVAL(PackedStringArray()));
+	ClassDB::bind_method(D_METHOD("build_seed_index"), &Tunepal::build_seed_index);
+	ClassDB::bind_method(D_METHOD("set_seed_length", "length"), &Tunepal::set_seed_length);
+	ClassDB::bind_method(D_METHOD("get_seed_length"), &Tunepal::get_seed_length);
+	ClassDB::bind_method(D_METHOD("set_seed_band", "band"), &Tunepal::set_seed_band);
+	ClassDB::bind_method(D_METHOD("get_seed_band"), &Tunepal::get_seed_band);
+	ClassDB::bind_method(D_METHOD("set_seed_clusters", "count"), &Tunepal::set_seed_clusters);
+	ClassDB::bind_method(D_METHOD("get_seed_clusters"), &Tunepal::get_seed_clusters);
+	ClassDB::bind_method(D_METHOD("search_seeded", "query", "max_results", "time_sigs"), &Tunepal::search_seeded, DEFVAL(PackedStringArray()));
+	ClassDB::bind_method(D_METHOD("compare_seeded_search", "queries", "max_results"), &Tunepal::compare_seeded_search, DEFVAL(10));
+	ClassDB::bind_method(D_METHOD("set_match_locations", "count"), &Tunepal::set_match_locations);
+	ClassDB::bind_method(D_METHOD("get_match_locations"), &Tunepal::get_match_locations);
+	ClassDB::bind_method(D_METHOD("set_cache_budget", "bytes"), &Tunepal::set_cache_budget);
+	ClassDB::bind_method(D_METHOD("clear_cache"), &Tunepal::clear_cache);
+	ClassDB::bind_method(D_METHOD("get_cache_stats"), &Tunepal::get_cache_stats);
+	ClassDB::bind_method(D_METHOD("get_scratch_stats"), &Tunepal::get_scratch_stats);
+
+	ClassDB::bind_method(D_METHOD("reset_segmenter", "sample_rate"), &Tunepal::reset_segmenter, DEFVAL(44100.0));
+	ClassDB::bind_method(D_METHOD("push_audio", "frames"), &Tunepal::push_audio);
+	ClassDB::bind_method(D_METHOD("push_samples", "samples"), &Tunepal::push_samples);
+	ClassDB::bind_method(D_METHOD("finish_segmenter"), &Tunepal::finish_segmenter);
+	ClassDB::bind_method(D_METHOD("get_note_events"), &Tunepal::get_note_events);
+	ClassDB::bind_method(D_METHOD("get_segmented_query"), &Tunepal::get_segmented_query);
+	ClassDB::bind_method(D_METHOD("get_unit_length"), &Tunepal::get_unit_length);
+
+	ClassDB::bind_method(D_METHOD("replay_fixtures", "paths", "expected_ids", "max_results"), &Tunepal::replay_fixtures, DEFVAL(10));
+
+	ClassDB::bind_method(D_METHOD("set_tracing", "enabled"), &Tunepal::set_tracing);
+	ClassDB::bind_method(D_METHOD("is_tracing"), &Tunepal::is_tracing);
+	ClassDB::bind_method(D_METHOD("clear_trace"), &Tunepal::clear_trace);
+	ClassDB::bind_method(D_METHOD("dump_trace", "path"), &Tunepal::dump_trace);
 }
 
 Tunepal::Tunepal() {
@@ -19,6 +108,11 @@ Tunepal::Tunepal() {
 
 Tunepal::~Tunepal() {
 	// Add your cleanup here.
+	cancel_loading = true;
+	if (loader.joinable())
+	{
+		loader.join();
+	}
 }
 
 void Tunepal::_process(double delta) {
@@ -30,13 +124,9 @@ void Tunepal::_process(double delta) {
 
 int Tunepal::edSubstring(const godot::String pattern, const godot::String text, const int thread_id)
 {
-	//return 666;
-	int matrix[400][400];
 	int pLength = pattern.length();
 	int tLength = text.length();
-	int difference = 0;
 
-	char sc;
 	//UtilityFunctions::print("edsubstring: ", pattern, text, thread_id);
 	if (pLength == 0)
 	{
@@ -47,59 +137,1589 @@ int Tunepal::edSubstring(const godot::String pattern, const godot::String text,
 		return 0;
 	}
 
-	
-	// Initialise the 0 row
-	for (int i = 0; i < tLength + 1; i++)
+	// A single DP row from this thread's scratch arena (see core/alignment.h)
+	// rather than a 400x400 matrix on the stack, so keys of any length are safe
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+
+	char *p = arena.alloc<char>(pLength);
+	for (int i = 0; i < pLength; i++)
+	{
+		p[i] = pattern[i];
+	}
+	return tunepal::EdSubstringAligner<>::align(p, pLength, text.ptr(), tLength);
+}
+
+void Tunepal::clear_corpus()
+{
+	corpus.clear();
+	features.clear();
+	layout.clear();
+	fm_index.clear();
+	tune_rows.clear();
+	query_cache.clear();
+}
+
+// Light row of a tune added without its database columns, so tune_rows
+// stays indexed like the corpus
+static Dictionary light_row(const int id, const godot::String &time_sig)
+{
+	Dictionary row;
+	row["id"] = id;
+	row["time_sig"] = time_sig;
+	row["title"] = Variant();
+	row["tune_type"] = Variant();
+	row["key_sig"] = Variant();
+	row["shortName"] = Variant();
+	return row;
+}
+
+int Tunepal::add_tune(const int id, const godot::String search_key, const godot::String time_sig)
+{
+	int index = corpus.add(id, search_key.utf8().get_data(), time_sig.utf8().get_data());
+	features.add(corpus.key(index), corpus.key_length(index));
+	tune_rows.append(light_row(id, time_sig));
+	return index;
+}
+
+void Tunepal::add_tunes(const PackedInt32Array ids, const PackedStringArray search_keys, const PackedStringArray time_sigs)
+{
+	if (ids.size() != search_keys.size() || ids.size() != time_sigs.size())
 	{
-		matrix[0][i] = 0;
+		UtilityFunctions::push_error("add_tunes: ids, search_keys and time_sigs must be the same size");
+		return;
 	}
-	// Now make the 0 col = 0,1,2,3,4,5,6
-	for (int i = 0; i < pLength + 1; i++)
+	for (int i = 0; i < ids.size(); i++)
 	{
-		matrix[i][0] = i;
+		int index = corpus.add(ids[i], search_keys[i].utf8().get_data(), time_sigs[i].utf8().get_data());
+		features.add(corpus.key(index), corpus.key_length(index));
+		tune_rows.append(light_row(ids[i], time_sigs[i]));
 	}
+	ensure_layout();
+}
 
+int Tunepal::get_corpus_size()
+{
+	return corpus.size();
+}
+
+void Tunepal::set_min_key_length(const int length)
+{
+	min_key_length = length;
+}
+
+int Tunepal::get_min_key_length()
+{
+	return min_key_length;
+}
+
+// The length buckets the scans walk, shortest first. Tunes added since the
+// layout was last built are scanned after them and are in no bucket.
+Array Tunepal::get_length_buckets()
+{
+	ensure_layout();
+	Array result;
+	for (size_t b = 0; b < layout.bucket_count(); b++)
+	{
+		const tunepal::LengthBuckets::Bucket &bucket = layout.bucket(b);
+		Dictionary entry;
+		entry["min_length"] = bucket.min_length;
+		entry["max_length"] = bucket.max_length;
+		entry["tunes"] = (int64_t)(bucket.end - bucket.begin);
+		result.append(entry);
+	}
+	return result;
+}
 
-	for (int i = 1; i <= pLength; i++)
+// Search keys plus the few columns lists and results show; the bulky ones
+// (notation, midi_sequence) are left in the database until a tune is opened.
+// Pages are read in id order and continue after the last id seen (keyset
+// pagination), so each page is an index seek rather than an OFFSET scan.
+static const char *CORPUS_PAGE_QUERY = "select tuneindex.id as id, search_key, time_sig, title, tune_type, key_sig, shortName "
+		"from tuneindex, tunekeys, source where tunekeys.tuneid = tuneindex.id and tuneindex.source = source.id "
+		"and source.id = ? and tuneindex.id > ? order by tuneindex.id limit ?;";
+// Counts the rows the page query returns, so progress ends at its total
+static const char *CORPUS_COUNT_QUERY = "select count(*) as total from tuneindex, tunekeys, source "
+		"where tunekeys.tuneid = tuneindex.id and tuneindex.source = source.id and source.id = ?;";
+static const char *TUNE_DETAIL_QUERY = "select tuneindex.id as id, midi_sequence, tune_type, time_sig, notation, source.id as sourceid, "
+		"shortName, url, source.source as sourcename, title, alt_title, tunepalid, x, midi_file_name, key_sig "
+		"from tuneindex, source where tuneindex.source = source.id and tuneindex.id = ?;";
+
+// Opens the database through the godot-sqlite extension; null if it is missing or the open fails
+static Variant open_database(const godot::String &path)
+{
+	Variant handle = ClassDBSingleton::get_singleton()->instantiate("SQLite");
+	Object *db = handle;
+	if (db == nullptr)
+	{
+		return Variant();
+	}
+	db->set("path", path);
+	db->set("read_only", true);
+	db->set("verbosity_level", 0);
+	if (!(bool)db->call("open_db"))
+	{
+		return Variant();
+	}
+	return handle;
+}
+
+// Replaces the corpus with the search keys of one tune source, read on a
+// background thread. corpus_progress(loaded, total) is emitted as pages
+// arrive and corpus_ready(count) once the last one is in. Returns false
+// if a load is already running.
+bool Tunepal::load_corpus(const godot::String path, const int source, const int page_size)
+{
+	if (loading)
+	{
+		return false;
+	}
+	if (loader.joinable())
+	{
+		loader.join();
+	}
+	clear_corpus();
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex);
+		loaded_pages.clear();
+	}
+	database_path = path;
+	load_total = 0;
+	cancel_loading = false;
+	loading = true;
+	loader = std::thread(&Tunepal::load_pages, this, path, source, std::max(page_size, 1));
+	return true;
+}
+
+// Loader thread: only touches the queue, never the corpus
+void Tunepal::load_pages(const godot::String path, const int source, const int page_size)
+{
+	Variant handle = open_database(path);
+	Object *db = handle;
+	if (db == nullptr)
+	{
+		UtilityFunctions::push_error("load_corpus: could not open ", path);
+	}
+	else
 	{
-		sc = pattern[i - 1];
-		for (int j = 1; j <= tLength; j++)
+		Array count_bindings;
+		count_bindings.append(source);
+		if ((bool)db->call("query_with_bindings", CORPUS_COUNT_QUERY, count_bindings))
+		{
+			Array counted = db->get("query_result");
+			if (counted.size() > 0)
+			{
+				load_total = (int64_t)Dictionary(counted[0])["total"];
+			}
+		}
+
+		int64_t last_id = -1;
+		while (!cancel_loading)
 		{
-			int v = matrix[i - 1][j - 1];
-			//if ((text.charAt(j - 1) != sc) && (text.charAt(j - 1) != 'Z') && sc != 'Z')                
-			if ((text[j - 1] != sc)  && sc != 'Z')
+			Array bindings;
+			bindings.append(source);
+			bindings.append(last_id);
+			bindings.append(page_size);
+			if (!(bool)db->call("query_with_bindings", CORPUS_PAGE_QUERY, bindings))
+			{
+				break;
+			}
+			Array rows = db->get("query_result");
+			if (rows.is_empty())
 			{
-				difference = 1;
+				break;
+			}
+
+			tunepal::TraceSpan span("load page", rows.size());
+			LoadedPage page;
+			for (int64_t i = 0; i < rows.size(); i++)
+			{
+				Dictionary row = rows[i];
+				Variant key = row["search_key"];
+				Variant time_sig = row["time_sig"];
+				page.ids.push_back((int64_t)row["id"]);
+				page.keys.push_back(key.get_type() == Variant::NIL ? "" : godot::String(key).utf8().get_data());
+				page.time_sigs.push_back(time_sig.get_type() == Variant::NIL ? "" : godot::String(time_sig).utf8().get_data());
+				// The key lives in the corpus; keep the row light
+				row.erase("search_key");
+				page.rows.append(row);
+			}
+			last_id = page.ids.back();
+			{
+				std::lock_guard<std::mutex> lock(loaded_mutex);
+				loaded_pages.push_back(std::move(page));
+			}
+			call_deferred("_apply_loaded_pages");
+			if (rows.size() < page_size)
+			{
+				break;
+			}
+		}
+		db->call("close_db");
+	}
+	loading = false;
+	call_deferred("_apply_loaded_pages");
+}
+
+// Main thread: moves queued pages into the corpus and reports progress
+void Tunepal::_apply_loaded_pages()
+{
+	// Read before draining: once the loader is done every page is queued
+	bool done = !loading;
+	std::vector<LoadedPage> pages;
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex);
+		pages.swap(loaded_pages);
+	}
+	tunepal::TraceSpan span("apply pages", (int64_t)pages.size());
+	for (LoadedPage &page : pages)
+	{
+		for (size_t i = 0; i < page.ids.size(); i++)
+		{
+			int index = corpus.add(page.ids[i], page.keys[i], page.time_sigs[i]);
+			features.add(corpus.key(index), corpus.key_length(index));
+			tune_rows.append(page.rows[i]);
+		}
+	}
+	if (!pages.empty())
+	{
+		emit_signal("corpus_progress", (int64_t)corpus.size(), std::max(load_total.load(), (int64_t)corpus.size()));
+	}
+	if (done && loader.joinable())
+	{
+		loader.join();
+		ensure_layout();
+		emit_signal("corpus_ready", (int64_t)corpus.size());
+	}
+}
+
+bool Tunepal::is_corpus_loading()
+{
+	return loading || loader.joinable();
+}
+
+// Light rows (id, title, time_sig, tune_type, key_sig, shortName) of every
+// tune in the corpus, indexed like search results
+Array Tunepal::get_tune_rows()
+{
+	return tune_rows;
+}
+
+// Every column of a loaded tune, read from the database on demand
+Dictionary Tunepal::fetch_tune(const int index)
+{
+	Dictionary tune;
+	if (index < 0 || index >= tune_rows.size())
+	{
+		return tune;
+	}
+	tune = Dictionary(tune_rows[index]).duplicate();
+	// Tunes added with add_abc_tune are not in the database
+	if (tune.has("notation"))
+	{
+		return tune;
+	}
+	Variant handle = open_database(database_path);
+	Object *db = handle;
+	if (db == nullptr)
+	{
+		return tune;
+	}
+	Array bindings;
+	bindings.append(tune["id"]);
+	if ((bool)db->call("query_with_bindings", TUNE_DETAIL_QUERY, bindings))
+	{
+		Array rows = db->get("query_result");
+		if (rows.size() > 0)
+		{
+			tune.merge(rows[0], true);
+		}
+	}
+	db->call("close_db");
+	return tune;
+}
+
+static PackedInt32Array to_packed(const std::vector<uint8_t> &values)
+{
+	PackedInt32Array packed;
+	packed.resize(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		packed.set(i, values[i]);
+	}
+	return packed;
+}
+
+// The search key ABC notation normalizes to, with the MIDI pitch, notation
+// bar and byte offset behind every key symbol, and the T:, M: and K: fields
+Dictionary Tunepal::index_abc(const godot::String notation)
+{
+	CharString raw = notation.utf8();
+	abc_indexer.index(raw.get_data(), raw.length(), abc_tune);
+	Dictionary result;
+	result["search_key"] = godot::String(abc_tune.search_key.c_str());
+	result["pitches"] = to_packed(abc_tune.pitches);
+	PackedInt32Array bars;
+	PackedInt32Array offsets;
+	bars.resize(abc_tune.bars.size());
+	offsets.resize(abc_tune.offsets.size());
+	for (size_t i = 0; i < abc_tune.bars.size(); i++)
+	{
+		bars.set(i, abc_tune.bars[i]);
+		offsets.set(i, abc_tune.offsets[i]);
+	}
+	result["bars"] = bars;
+	result["offsets"] = offsets;
+	result["title"] = godot::String::utf8(abc_tune.title.c_str());
+	result["meter"] = godot::String(abc_tune.meter.c_str());
+	result["key_sig"] = godot::String(abc_tune.key.c_str());
+	return result;
+}
+
+// Indexes a tune's notation and appends it to the corpus, its feature
+// vectors and (on the next seeded search) the seed index, without
+// reloading anything. time_sig defaults to the tune's M: field. Returns
+// the corpus index, or -1 if the notation has no notes or is too long to
+// index (see core/abc_indexer.h).
+int Tunepal::add_abc_tune(const int id, const godot::String notation, const godot::String time_sig)
+{
+	CharString raw = notation.utf8();
+	if (!abc_indexer.index(raw.get_data(), raw.length(), abc_tune))
+	{
+		UtilityFunctions::push_error("add_abc_tune: no notes, or notes too long, in the notation of tune ", id);
+		return -1;
+	}
+	std::string meter = time_sig.is_empty() ? abc_tune.meter : std::string(time_sig.utf8().get_data());
+	bool rows_in_step = tune_rows.size() == (int64_t)corpus.size();
+	int index = corpus.add(id, abc_tune.search_key, meter);
+	features.add(corpus.key(index), corpus.key_length(index));
+
+	// Results open tunes by corpus index, so only extend rows that line up
+	if (rows_in_step)
+	{
+		// Note numbers, which TunepalMidi.load_sequence plays
+		std::string notes;
+		for (size_t i = 0; i < abc_tune.pitches.size(); i++)
+		{
+			notes += (i > 0 ? "," : "") + std::to_string(abc_tune.pitches[i]);
+		}
+		Dictionary row;
+		row["id"] = id;
+		row["title"] = godot::String::utf8(abc_tune.title.c_str());
+		row["time_sig"] = godot::String(meter.c_str());
+		row["tune_type"] = Variant();
+		row["key_sig"] = godot::String(abc_tune.key.c_str());
+		row["shortName"] = Variant();
+		row["notation"] = notation;
+		row["midi_sequence"] = godot::String(notes.c_str());
+		tune_rows.append(row);
+	}
+	return index;
+}
+
+static const char *NOTATION_QUERY = "select tuneindex.id as id, notation, search_key from tuneindex, tunekeys "
+		"where tunekeys.tuneid = tuneindex.id and tuneindex.source = ?;";
+
+// Throughput test: re-derives the search key of every tune of a source from
+// its notation, on all cores, and reports how many match the stored keys
+Dictionary Tunepal::reindex_notation(const godot::String path, const int source)
+{
+	typedef std::chrono::steady_clock Clock;
+	Dictionary report;
+	Clock::time_point read_start = Clock::now();
+	Variant handle = open_database(path);
+	Object *db = handle;
+	if (db == nullptr)
+	{
+		UtilityFunctions::push_error("reindex_notation: could not open ", path);
+		return report;
+	}
+	Array bindings;
+	bindings.append(source);
+	Array rows;
+	if ((bool)db->call("query_with_bindings", NOTATION_QUERY, bindings))
+	{
+		rows = db->get("query_result");
+	}
+	db->call("close_db");
+
+	std::vector<CharString> notations(rows.size());
+	std::vector<std::string> stored(rows.size());
+	for (int64_t i = 0; i < rows.size(); i++)
+	{
+		Dictionary row = rows[i];
+		Variant notation = row["notation"];
+		Variant key = row["search_key"];
+		if (notation.get_type() != Variant::NIL)
+		{
+			notations[i] = godot::String(notation).utf8();
+		}
+		if (key.get_type() != Variant::NIL)
+		{
+			stored[i] = normalize_query(key);
+		}
+	}
+	rows.clear();
+	double read_ms = std::chrono::duration<double, std::milli>(Clock::now() - read_start).count();
+
+	std::vector<tunepal::AbcIndexer> indexers(tunepal::worker_count());
+	std::vector<uint8_t> matched(notations.size(), 0);
+	std::vector<size_t> symbols(indexers.size(), 0);
+	Clock::time_point index_start = Clock::now();
+	tunepal::parallel_for(notations.size(), 64, [&](size_t begin, size_t end, int worker) {
+		tunepal::AbcIndexedTune tune;
+		for (size_t i = begin; i < end; i++)
+		{
+			indexers[worker].index(notations[i].get_data(), notations[i].length(), tune);
+			symbols[worker] += tune.search_key.size();
+			matched[i] = !stored[i].empty() && tune.search_key == stored[i];
+		}
+	});
+	double index_ms = std::chrono::duration<double, std::milli>(Clock::now() - index_start).count();
+
+	size_t total_symbols = 0;
+	for (size_t s : symbols)
+	{
+		total_symbols += s;
+	}
+	int64_t matching = std::count(matched.begin(), matched.end(), 1);
+	report["tunes"] = (int64_t)notations.size();
+	report["symbols"] = (int64_t)total_symbols;
+	report["read_ms"] = read_ms;
+	report["index_ms"] = index_ms;
+	report["tunes_per_second"] = index_ms > 0.0 ? notations.size() * 1000.0 / index_ms : 0.0;
+	report["matching_keys"] = matching;
+	report["key_agreement"] = notations.empty() ? 0.0 : matching / (double)notations.size();
+	return report;
+}
+
+// Maps a match in a tune's search key (the start and end of a search
+// result) back to its notation: the bars and byte offsets of the first and
+// last matched notes. Empty if the notation does not reach that far.
+Dictionary Tunepal::locate_in_notation(const godot::String notation, const int start, const int end)
+{
+	Dictionary location;
+	CharString raw = notation.utf8();
+	abc_indexer.index(raw.get_data(), raw.length(), abc_tune);
+	int length = abc_tune.search_key.length();
+	if (start < 0 || start >= length || end <= start)
+	{
+		return location;
+	}
+	int last = std::min(end, length) - 1;
+	location["bar"] = abc_tune.bars[start];
+	location["end_bar"] = abc_tune.bars[last];
+	location["offset"] = (int64_t)abc_tune.offsets[start];
+	location["end_offset"] = (int64_t)abc_tune.offsets[last];
+	return location;
+}
+
+// 0 scores every candidate exactly; otherwise only the `count` tunes whose
+// feature vectors are closest to the query's (see core/feature_index.h)
+void Tunepal::set_coarse_candidates(const int count)
+{
+	coarse_candidates = std::max(count, 0);
+}
+
+int Tunepal::get_coarse_candidates()
+{
+	return coarse_candidates;
+}
+
+// Corpus indices of the `count` tunes the coarse ranker keeps for a query,
+// e.g. to narrow the candidate list of a DTW search
+PackedInt32Array Tunepal::coarse_rank(const godot::String query, const int count)
+{
+	PackedInt32Array result;
+	std::string pattern = normalize_query(query);
+	std::vector<uint32_t> candidates = collect_candidates(PackedStringArray());
+	int8_t query_features[tunepal::FeatureIndex::DIMENSIONS];
+	tunepal::FeatureIndex::extract(pattern.data(), pattern.length(), query_features);
+	features.select(query_features, candidates, std::max(count, 0));
+	std::sort(candidates.begin(), candidates.end());
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		result.append(candidates[i]);
+	}
+	return result;
+}
+
+// The context is everything besides the query that changes the scores, so a
+// cached entry is only reused for the same matcher, filters and corpus.
+std::string Tunepal::search_context(const PackedStringArray &time_sigs) const
+{
+	std::vector<std::string> sigs;
+	for (int i = 0; i < time_sigs.size(); i++)
+	{
+		sigs.push_back(time_sigs[i].utf8().get_data());
+	}
+	std::sort(sigs.begin(), sigs.end());
+	sigs.erase(std::unique(sigs.begin(), sigs.end()), sigs.end());
+
+	std::string context = "edsubstring|" + std::to_string(min_key_length) + "|" + std::to_string(coarse_candidates) + "|"
+			+ std::to_string(corpus.generation()) + "|";
+	for (const std::string &sig : sigs)
+	{
+		context += sig + ",";
+	}
+	return context;
+}
+
+// Tunes appended since the last build are scanned after the laid-out ones, in
+// corpus order, so adding a few does not rebuild the layout; it is rebuilt
+// once they make up more than an eighth of the corpus or the corpus is replaced
+void Tunepal::ensure_layout()
+{
+	size_t unlaid = corpus.size() - std::min(layout.size(), corpus.size());
+	if (!layout.current(corpus) || unlaid > std::max<size_t>(corpus.size() / 8, 64))
+	{
+		layout.build(corpus);
+	}
+}
+
+// Key of a corpus entry for the scans: from the length-ordered copy when it is
+// current, so candidates in layout order are read front to back
+const char *Tunepal::scan_key(const uint32_t index) const
+{
+	return layout.current(corpus) && index < layout.size() ? layout.key(layout.position(index)) : corpus.key(index);
+}
+
+// Corpus indices a search scores: keys long enough to match, in the wanted time
+// signatures. Layout order (shortest keys first, then tunes appended since the
+// last build) when the layout is current, else corpus order.
+std::vector<uint32_t> Tunepal::collect_candidates(const PackedStringArray &time_sigs) const
+{
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+	bool *allowed = nullptr;
+	if (time_sigs.size() > 0)
+	{
+		allowed = arena.alloc<bool>(corpus.size());
+		std::fill(allowed, allowed + corpus.size(), false);
+		for (int i = 0; i < time_sigs.size(); i++)
+		{
+			int sig = corpus.find_time_sig(time_sigs[i].utf8().get_data());
+			for (size_t t = 0; sig >= 0 && t < corpus.size(); t++)
+			{
+				if (corpus.time_sig_id(t) == sig)
+				{
+					allowed[t] = true;
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> candidates;
+	bool ordered = layout.current(corpus);
+	for (size_t p = 0; p < corpus.size(); p++)
+	{
+		uint32_t t = ordered ? layout.index(p) : p;
+		if (corpus.key_length(t) >= min_key_length && (allowed == nullptr || allowed[t]))
+		{
+			candidates.push_back(t);
+		}
+	}
+	return candidates;
+}
+
+std::shared_ptr<Tunepal::SearchCacheEntry> Tunepal::score_corpus(const std::string &context, const std::string &pattern,
+		const PackedStringArray &time_sigs, const std::shared_ptr<const SearchCacheEntry> &resume_from, const bool keep_rows_allowed)
+{
+	std::shared_ptr<SearchCacheEntry> entry = std::make_shared<SearchCacheEntry>();
+	entry->context = context;
+	entry->query = pattern;
+
+	if (resume_from)
+	{
+		entry->candidates = resume_from->candidates;
+	}
+	else
+	{
+		entry->candidates = collect_candidates(time_sigs);
+		if (coarse_candidates > 0)
+		{
+			int8_t query_features[tunepal::FeatureIndex::DIMENSIONS];
+			tunepal::FeatureIndex::extract(pattern.data(), pattern.length(), query_features);
+			features.select(query_features, entry->candidates, coarse_candidates);
+			if (layout.current(corpus))
+			{
+				layout.arrange(entry->candidates);
+			}
+		}
+	}
+
+	size_t count = entry->candidates.size();
+	tunepal::TraceSpan span("score corpus", (int64_t)count);
+	size_t cells = 0;
+	entry->row_offsets.resize(count);
+	for (size_t c = 0; c < count; c++)
+	{
+		entry->row_offsets[c] = cells;
+		cells += corpus.key_length(entry->candidates[c]) + 1;
+	}
+
+	// Rows are uint16_t, which bounds the distance by the query length
+	bool keep_rows = keep_rows_allowed && pattern.length() < 0xFFFF && cells * sizeof(uint16_t) <= query_cache.budget();
+	int rows_done = 0;
+	if (keep_rows && resume_from && resume_from->has_rows())
+	{
+		entry->rows = resume_from->rows;
+		rows_done = resume_from->query.length();
+	}
+	else if (keep_rows)
+	{
+		entry->rows.resize(cells);
+	}
+	else
+	{
+		entry->row_offsets.clear();
+	}
+
+	entry->scores.resize(count);
+	const char *suffix = pattern.data() + rows_done;
+	int suffix_length = pattern.length() - rows_done;
+
+	// Chunks are cut by DP cells, so long keys do not pile up on one worker
+	tunepal::parallel_for_weighted(count, [&](size_t c) {
+		return (size_t)(corpus.key_length(entry->candidates[c]) + 1) * suffix_length;
+	}, MIN_CHUNK_CELLS, [&](size_t begin, size_t end, int) {
+		tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+		for (size_t c = begin; c < end; c++)
+		{
+			tunepal::ScratchArena::Scope scope(arena);
+			size_t t = entry->candidates[c];
+			const char *key = scan_key(t);
+			int key_length = corpus.key_length(t);
+			if (keep_rows)
+			{
+				uint16_t *row = entry->rows.data() + entry->row_offsets[c];
+				if (rows_done == 0)
+				{
+					tunepal::EdSubstringAligner<uint16_t>::init_row(row, key_length);
+				}
+				tunepal::EdSubstringAligner<uint16_t>::advance(row, rows_done, suffix, suffix_length, key, key_length);
+				entry->scores[c] = tunepal::EdSubstringAligner<uint16_t>::finish(row, key_length);
 			}
 			else
 			{
-				difference = 0;
+				entry->scores[c] = tunepal::EdSubstringAligner<>::align(pattern.data(), pattern.length(), key, key_length);
+			}
+		}
+	});
+
+	return entry;
+}
+
+// Best max_results candidates for a normalized pattern, lowest distance first.
+// Without the cache every call rescans the corpus, which is what the replay
+// harness wants to time; it is also safe to call from several threads.
+std::vector<Tunepal::SearchHit> Tunepal::rank_corpus(const std::string &pattern, const int max_results,
+		const PackedStringArray &time_sigs, const bool use_cache)
+{
+	std::vector<SearchHit> hits;
+	if (pattern.empty() || max_results <= 0)
+	{
+		return hits;
+	}
+
+	std::string context = search_context(time_sigs);
+	std::shared_ptr<const SearchCacheEntry> entry = use_cache ? query_cache.find(context, pattern) : nullptr;
+	if (!entry)
+	{
+		// The coarse ranker picks candidates per query, so a prefix's rows cannot be reused and
+		// keeping this query's rows would only spend cache budget
+		bool resume = use_cache && coarse_candidates == 0;
+		std::shared_ptr<const SearchCacheEntry> prefix = resume ? query_cache.find_prefix(context, pattern, max_prefix_extension) : nullptr;
+		std::shared_ptr<SearchCacheEntry> scored = score_corpus(context, pattern, time_sigs, prefix, resume);
+		if (use_cache)
+		{
+			query_cache.insert(scored);
+		}
+		entry = scored;
+	}
+
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+	size_t candidate_count = entry->candidates.size();
+	tunepal::TraceSpan span("merge", (int64_t)candidate_count);
+	uint32_t *order = arena.alloc<uint32_t>(candidate_count);
+	for (size_t c = 0; c < candidate_count; c++)
+	{
+		order[c] = c;
+	}
+	size_t count = std::min(candidate_count, (size_t)max_results);
+	std::partial_sort(order, order + count, order + candidate_count, [&](uint32_t a, uint32_t b) {
+		if (entry->scores[a] != entry->scores[b])
+		{
+			return entry->scores[a] < entry->scores[b];
+		}
+		return entry->candidates[a] < entry->candidates[b];
+	});
+
+	hits.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		hits[i].index = entry->candidates[order[i]];
+		hits[i].distance = entry->scores[order[i]];
+	}
+	return hits;
+}
+
+Array Tunepal::search(const godot::String query, const int max_results, const PackedStringArray time_sigs)
+{
+	tunepal::TraceSpan span("search");
+	Array results;
+
+	ensure_layout();
+	std::string pattern = normalize_query(query);
+	std::vector<SearchHit> hits = rank_corpus(pattern, max_results, time_sigs, true);
+	tunepal::TraceSpan hydrate("hydrate results", (int64_t)hits.size());
+	for (size_t i = 0; i < hits.size(); i++)
+	{
+		Dictionary result;
+		result["index"] = hits[i].index;
+		result["id"] = corpus.id(hits[i].index);
+		result["distance"] = hits[i].distance;
+		result["confidence"] = 1.0 - (hits[i].distance / (double)pattern.length());
+		results.append(result);
+	}
+	add_match_locations(results, pattern);
+	return results;
+}
+
+// Scores many queries in one pass over the corpus (see core/batch_scoring.h).
+// Results match search() for each query, including the coarse ranker's
+// per-query candidates; the query cache is not consulted.
+Array Tunepal::search_batch(const PackedStringArray queries, const int max_results, const PackedStringArray time_sigs)
+{
+	tunepal::TraceSpan span("search batch", queries.size());
+	Array results;
+	std::vector<std::string> patterns(queries.size());
+	for (int q = 0; q < queries.size(); q++)
+	{
+		patterns[q] = normalize_query(queries[q]);
+	}
+
+	ensure_layout();
+	std::vector<uint32_t> candidates = collect_candidates(time_sigs);
+	size_t k = max_results > 0 ? (size_t)max_results : 0;
+
+	// The pass is shared, so each query masks out what its coarse selection drops
+	std::vector<uint8_t> kept;
+	if (coarse_candidates > 0 && candidates.size() > (size_t)coarse_candidates)
+	{
+		std::vector<uint32_t> position(corpus.size());
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			position[candidates[c]] = c;
+		}
+		kept.assign(patterns.size() * candidates.size(), 0);
+		for (size_t q = 0; q < patterns.size(); q++)
+		{
+			int8_t query_features[tunepal::FeatureIndex::DIMENSIONS];
+			tunepal::FeatureIndex::extract(patterns[q].data(), patterns[q].length(), query_features);
+			std::vector<uint32_t> selected = candidates;
+			features.select(query_features, selected, coarse_candidates);
+			for (size_t s = 0; s < selected.size(); s++)
+			{
+				kept[q * candidates.size() + position[selected[s]]] = 1;
+			}
+		}
+	}
+
+	std::vector<std::vector<tunepal::BatchHit<int>>> hits = tunepal::score_batch<int>(patterns.size(), candidates.size(), k, true,
+			[&](size_t c) {
+				return (size_t)corpus.key_length(candidates[c]) * (1 + sizeof(int));
+			},
+			[&](size_t q, size_t c, const int *cutoff, int &distance) {
+				const std::string &pattern = patterns[q];
+				if (pattern.empty() || (!kept.empty() && !kept[q * candidates.size() + c]))
+				{
+					return false;
+				}
+				const char *key = scan_key(candidates[c]);
+				int key_length = corpus.key_length(candidates[c]);
+
+				tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+				tunepal::ScratchArena::Scope scope(arena);
+				int *row = arena.alloc<int>(key_length + 1);
+				tunepal::EdSubstringAligner<>::init_row(row, key_length);
+				if (cutoff == nullptr)
+				{
+					tunepal::EdSubstringAligner<>::advance(row, 0, pattern.data(), pattern.length(), key, key_length);
+				}
+				else if (!tunepal::EdSubstringAligner<>::advance_bounded(row, 0, pattern.data(), pattern.length(), key, key_length, *cutoff))
+				{
+					return false;
+				}
+				distance = tunepal::EdSubstringAligner<>::finish(row, key_length);
+				return true;
+			},
+			candidates.data());
+
+	tunepal::TraceSpan hydrate("hydrate results");
+	for (size_t q = 0; q < patterns.size(); q++)
+	{
+		Array query_results;
+		for (size_t i = 0; i < hits[q].size(); i++)
+		{
+			uint32_t t = hits[q][i].index;
+			int distance = hits[q][i].score;
+			Dictionary result;
+			result["index"] = t;
+			result["id"] = corpus.id(t);
+			result["distance"] = distance;
+			result["confidence"] = 1.0 - (distance / (double)patterns[q].length());
+			query_results.append(result);
+		}
+		add_match_locations(query_results, patterns[q]);
+		results.append(query_results);
+	}
+	return results;
+}
+
+// Exact top-k of a pattern over the given candidates, without the cache
+std::vector<Tunepal::SearchHit> Tunepal::rank_candidates(const std::string &pattern, const std::vector<uint32_t> &candidates, const size_t k) const
+{
+	std::vector<SearchHit> hits(candidates.size());
+	tunepal::parallel_for_weighted(candidates.size(), [&](size_t c) {
+		return (size_t)(corpus.key_length(candidates[c]) + 1) * pattern.length();
+	}, MIN_CHUNK_CELLS, [&](size_t begin, size_t end, int) {
+		for (size_t c = begin; c < end; c++)
+		{
+			uint32_t t = candidates[c];
+			hits[c].index = t;
+			hits[c].distance = tunepal::EdSubstringAligner<>::align(pattern.data(), pattern.length(), scan_key(t), corpus.key_length(t));
+		}
+	});
+	size_t count = std::min(k, hits.size());
+	std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), [](const SearchHit &a, const SearchHit &b) {
+		if (a.distance != b.distance)
+		{
+			return a.distance < b.distance;
+		}
+		return a.index < b.index;
+	});
+	hits.resize(count);
+	return hits;
+}
+
+// Recall@count of the coarse ranker: the share of the exhaustive top_k that
+// survives coarse selection, plus how often the exhaustive best survives and
+// the time both paths took. Use it to pick set_coarse_candidates().
+Dictionary Tunepal::measure_coarse_recall(const PackedStringArray queries, const int count, const int top_k)
+{
+	typedef std::chrono::steady_clock Clock;
+	ensure_layout();
+	std::vector<uint32_t> all = collect_candidates(PackedStringArray());
+	size_t k = std::max(top_k, 1);
+	double recall = 0.0;
+	int best_kept = 0;
+	int same_best = 0;
+	int measured = 0;
+	double exact_ms = 0.0;
+	double coarse_ms = 0.0;
+
+	for (int q = 0; q < queries.size(); q++)
+	{
+		std::string pattern = normalize_query(queries[q]);
+		if (pattern.empty() || all.empty())
+		{
+			continue;
+		}
+
+		Clock::time_point t0 = Clock::now();
+		std::vector<SearchHit> exact = rank_candidates(pattern, all, k);
+		Clock::time_point t1 = Clock::now();
+		std::vector<uint32_t> kept = all;
+		int8_t query_features[tunepal::FeatureIndex::DIMENSIONS];
+		tunepal::FeatureIndex::extract(pattern.data(), pattern.length(), query_features);
+		features.select(query_features, kept, std::max(count, 1));
+		std::sort(kept.begin(), kept.end());
+		std::vector<SearchHit> reranked = rank_candidates(pattern, kept, k);
+		Clock::time_point t2 = Clock::now();
+
+		size_t found = 0;
+		for (size_t i = 0; i < exact.size(); i++)
+		{
+			found += std::binary_search(kept.begin(), kept.end(), exact[i].index);
+		}
+		recall += found / (double)exact.size();
+		best_kept += std::binary_search(kept.begin(), kept.end(), exact[0].index);
+		same_best += reranked[0].distance == exact[0].distance;
+		measured++;
+		exact_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		coarse_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+	}
+
+	Dictionary result;
+	result["queries"] = measured;
+	result["candidates"] = (int64_t)all.size();
+	result["coarse_candidates"] = count;
+	result["top_k"] = (int64_t)k;
+	result["recall"] = measured > 0 ? recall / measured : 0.0;
+	result["best_recall"] = measured > 0 ? best_kept / (double)measured : 0.0;
+	result["best_distance_agreement"] = measured > 0 ? same_best / (double)measured : 0.0;
+	result["exact_ms"] = measured > 0 ? exact_ms / measured : 0.0;
+	result["coarse_ms"] = measured > 0 ? coarse_ms / measured : 0.0;
+	return result;
+}
+
+// Tunes appended since the last build are scanned directly by rank_seeded,
+// so adding a few does not rebuild the index; it is rebuilt once they make
+// up more than an eighth of the corpus or the corpus is replaced
+void Tunepal::ensure_fm_index()
+{
+	size_t unindexed = corpus.size() - std::min(fm_index.key_count(), corpus.size());
+	if (fm_index.empty() || fm_index.epoch() != corpus.epoch() || unindexed > std::max<size_t>(corpus.size() / 8, 64))
+	{
+		fm_index.build(corpus);
+	}
+}
+
+// Builds the seed index up front (search_seeded otherwise builds it on first use)
+Dictionary Tunepal::build_seed_index()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ensure_fm_index();
+	Dictionary result;
+	result["symbols"] = (int64_t)fm_index.size();
+	result["bytes"] = (int64_t)fm_index.memory_bytes();
+	result["build_ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Exact matches of this many notes anchor the alignments search_seeded verifies
+void Tunepal::set_seed_length(const int length)
+{
+	seed_length = std::max(length, 1);
+}
+
+int Tunepal::get_seed_length()
+{
+	return seed_length;
+}
+
+// Insertions or deletions a verified alignment may drift from its seed diagonal
+void Tunepal::set_seed_band(const int band)
+{
+	seed_band = std::max(band, 0);
+}
+
+int Tunepal::get_seed_band()
+{
+	return seed_band;
+}
+
+// Most seed clusters verified per query, the best supported first
+void Tunepal::set_seed_clusters(const int count)
+{
+	seed_clusters = std::max(count, 1);
+}
+
+int Tunepal::get_seed_clusters()
+{
+	return seed_clusters;
+}
+
+// How many of the best results carry start, end and ops: where in the search
+// key the query matched and how it aligned there (0 turns this off)
+void Tunepal::set_match_locations(const int count)
+{
+	match_locations = std::max(count, 0);
+}
+
+int Tunepal::get_match_locations()
+{
+	return match_locations;
+}
+
+// Linear-space traceback for the first match_locations results only, so
+// showing where a tune matched costs a few alignments, not a search
+void Tunepal::add_match_locations(Array &results, const std::string &pattern) const
+{
+	size_t count = std::min((size_t)results.size(), (size_t)match_locations);
+	std::vector<uint32_t> indices(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		indices[i] = (uint32_t)(int64_t)Dictionary(results[i])["index"];
+	}
+	std::vector<tunepal::AlignmentMatch> matches(count);
+	tunepal::parallel_for(count, 1, [&](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i++)
+		{
+			matches[i] = tunepal::EdSubstringTraceback::locate(pattern.data(), pattern.length(),
+					corpus.key(indices[i]), corpus.key_length(indices[i]));
+		}
+	});
+	for (size_t i = 0; i < count; i++)
+	{
+		Dictionary result = results[i];
+		result["start"] = matches[i].start;
+		result["end"] = matches[i].end;
+		result["ops"] = godot::String(matches[i].ops.c_str());
+	}
+}
+
+// Seed and extend: every seed_length window of the query is looked up in the
+// FM index, hits are grouped by tune and diagonal, and each group is verified
+// with a banded alignment around its diagonals instead of aligning the whole
+// key. Tunes sharing no seed with the query are never scored, so this can
+// miss matches the exhaustive scan finds (see compare_seeded_search).
+std::vector<Tunepal::SearchHit> Tunepal::rank_seeded(const std::string &pattern, const std::vector<uint32_t> &candidates, const size_t k) const
+{
+	int pattern_length = pattern.length();
+	if (pattern_length < seed_length)
+	{
+		return rank_candidates(pattern, candidates, k);
+	}
+
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+	bool *allowed = arena.alloc<bool>(corpus.size());
+	std::fill(allowed, allowed + corpus.size(), false);
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		allowed[candidates[c]] = true;
+	}
+
+	struct Seed
+	{
+		uint32_t key;
+		int diagonal;
+	};
+	// Wildcards and other symbols outside A-G only match in verification
+	std::vector<char> plain(pattern_length - seed_length + 1, 1);
+	for (int q = 0; q + seed_length <= pattern_length; q++)
+	{
+		for (int i = q; i < q + seed_length && plain[q]; i++)
+		{
+			plain[q] = tunepal::FmIndex::symbol(pattern[i]) != 9;
+		}
+	}
+
+	std::vector<Seed> seeds;
+	for (int q = 0; q + seed_length <= pattern_length; q++)
+	{
+		size_t lo = 0;
+		size_t hi = 0;
+		if (plain[q])
+		{
+			fm_index.find(pattern.data() + q, seed_length, lo, hi);
+		}
+		// Seeds this common (runs of one note, scale fragments) say nothing about the tune
+		if (hi - lo > (size_t)max_seed_hits)
+		{
+			continue;
+		}
+		for (size_t row = lo; row < hi; row++)
+		{
+			int offset = 0;
+			uint32_t key = fm_index.key_at(fm_index.locate(row), offset);
+			if (allowed[key])
+			{
+				Seed seed = { key, offset - q };
+				seeds.push_back(seed);
 			}
-			matrix[i][j] = UtilityFunctions::min(UtilityFunctions::min(matrix[i - 1][j] + 1, matrix[i][j - 1] + 1), v + difference);
 		}
 	}
-	//UtilityFunctions::print("Matrix:");
-	// for (int i = 0 ; i <= pLength ; i ++)
-	// {
-	// 	godot::String line = "";
-	// 	for (int j = 0 ; j <= tLength; j ++)
-	// 	{
-	// 		line += UtilityFunctions::str(matrix[i][j]) + "\t";
-	// 	}
-	// 	UtilityFunctions::print(line);
-	// }
-	int min = matrix[pLength][0];
-	for (int i = 0; i < tLength + 1; i++)
+	// Tunes added since the index was built: find the seeds by scanning their keys
+	for (size_t key = fm_index.key_count(); key < corpus.size(); key++)
 	{
-		int c = matrix[pLength][i];
-		// System.out.println(c);
-		if (c < min)
+		if (!allowed[key])
 		{
-			min = c;
+			continue;
 		}
+		const char *text = corpus.key(key);
+		int text_length = corpus.key_length(key);
+		for (int q = 0; q + seed_length <= pattern_length; q++)
+		{
+			if (!plain[q])
+			{
+				continue;
+			}
+			const char *seed = pattern.data() + q;
+			for (int offset = 0; offset + seed_length <= text_length; offset++)
+			{
+				if (std::equal(seed, seed + seed_length, text + offset))
+				{
+					Seed hit = { (uint32_t)key, offset - q };
+					seeds.push_back(hit);
+				}
+			}
+		}
+	}
+	std::sort(seeds.begin(), seeds.end(), [](const Seed &a, const Seed &b) {
+		return a.key != b.key ? a.key < b.key : a.diagonal < b.diagonal;
+	});
+
+	// Diagonals of one tune closer than the band are verified as one alignment
+	struct Cluster
+	{
+		uint32_t key;
+		int low;
+		int high;
+		int seeds;
+		int distance;
+	};
+	std::vector<Cluster> clusters;
+	for (size_t s = 0; s < seeds.size(); s++)
+	{
+		if (clusters.empty() || clusters.back().key != seeds[s].key || seeds[s].diagonal - clusters.back().high > seed_band)
+		{
+			Cluster cluster = { seeds[s].key, seeds[s].diagonal, seeds[s].diagonal, 0, 0 };
+			clusters.push_back(cluster);
+		}
+		clusters.back().high = seeds[s].diagonal;
+		clusters.back().seeds++;
+	}
+	if (clusters.size() > (size_t)seed_clusters)
+	{
+		std::nth_element(clusters.begin(), clusters.begin() + seed_clusters, clusters.end(), [](const Cluster &a, const Cluster &b) {
+			return a.seeds != b.seeds ? a.seeds > b.seeds : a.key < b.key;
+		});
+		clusters.resize(seed_clusters);
+	}
+
+	tunepal::TraceSpan verify("verify clusters", (int64_t)clusters.size());
+	tunepal::parallel_for(clusters.size(), 16, [&](size_t begin, size_t end, int) {
+		for (size_t c = begin; c < end; c++)
+		{
+			Cluster &cluster = clusters[c];
+			int spread = cluster.high - cluster.low;
+			cluster.distance = tunepal::BandedEdSubstringAligner::align(pattern.data(), pattern_length,
+					corpus.key(cluster.key), corpus.key_length(cluster.key), cluster.low + spread / 2, seed_band + (spread + 1) / 2);
+		}
+	});
+
+	// A tune scores its best cluster
+	std::vector<SearchHit> hits;
+	std::sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+		return a.key != b.key ? a.key < b.key : a.distance < b.distance;
+	});
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		if (c == 0 || clusters[c].key != clusters[c - 1].key)
+		{
+			SearchHit hit = { clusters[c].key, clusters[c].distance };
+			hits.push_back(hit);
+		}
+	}
+	size_t count = std::min(k, hits.size());
+	std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), [](const SearchHit &a, const SearchHit &b) {
+		if (a.distance != b.distance)
+		{
+			return a.distance < b.distance;
+		}
+		return a.index < b.index;
+	});
+	hits.resize(count);
+	return hits;
+}
+
+// Same results format as search(); not cached
+Array Tunepal::search_seeded(const godot::String query, const int max_results, const PackedStringArray time_sigs)
+{
+	Array results;
+	std::string pattern = normalize_query(query);
+	if (pattern.empty() || max_results <= 0)
+	{
+		return results;
+	}
+
+	tunepal::TraceSpan span("seeded search");
+	ensure_fm_index();
+	ensure_layout();
+	std::vector<SearchHit> hits = rank_seeded(pattern, collect_candidates(time_sigs), max_results);
+	tunepal::TraceSpan hydrate("hydrate results", (int64_t)hits.size());
+	for (size_t i = 0; i < hits.size(); i++)
+	{
+		Dictionary result;
+		result["index"] = hits[i].index;
+		result["id"] = corpus.id(hits[i].index);
+		result["distance"] = hits[i].distance;
+		result["confidence"] = 1.0 - (hits[i].distance / (double)pattern.length());
+		results.append(result);
+	}
+	add_match_locations(results, pattern);
+	return results;
+}
+
+// Seeded search against the exhaustive scan on the same queries: the share of
+// the exhaustive top max_results the seeded search also returns, how often
+// both agree on the best distance, and the mean time of each path.
+Dictionary Tunepal::compare_seeded_search(const PackedStringArray queries, const int max_results)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point build_start = Clock::now();
+	ensure_fm_index();
+	double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - build_start).count();
+
+	ensure_layout();
+	std::vector<uint32_t> all = collect_candidates(PackedStringArray());
+	size_t k = std::max(max_results, 1);
+	double recall = 0.0;
+	int same_best = 0;
+	int measured = 0;
+	double exhaustive_ms = 0.0;
+	double seeded_ms = 0.0;
+
+	for (int q = 0; q < queries.size(); q++)
+	{
+		std::string pattern = normalize_query(queries[q]);
+		if (pattern.empty() || all.empty())
+		{
+			continue;
+		}
+
+		Clock::time_point t0 = Clock::now();
+		std::vector<SearchHit> exact = rank_candidates(pattern, all, k);
+		Clock::time_point t1 = Clock::now();
+		std::vector<SearchHit> seeded = rank_seeded(pattern, all, k);
+		Clock::time_point t2 = Clock::now();
+
+		size_t found = 0;
+		for (size_t i = 0; i < exact.size(); i++)
+		{
+			for (size_t j = 0; j < seeded.size(); j++)
+			{
+				found += seeded[j].index == exact[i].index;
+			}
+		}
+		recall += found / (double)exact.size();
+		same_best += !seeded.empty() && seeded[0].distance == exact[0].distance;
+		measured++;
+		exhaustive_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		seeded_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+	}
+
+	Dictionary result;
+	result["queries"] = measured;
+	result["candidates"] = (int64_t)all.size();
+	result["top_k"] = (int64_t)k;
+	result["seed_length"] = seed_length;
+	result["seed_band"] = seed_band;
+	result["recall"] = measured > 0 ? recall / measured : 0.0;
+	result["best_distance_agreement"] = measured > 0 ? same_best / (double)measured : 0.0;
+	result["exhaustive_ms"] = measured > 0 ? exhaustive_ms / measured : 0.0;
+	result["seeded_ms"] = measured > 0 ? seeded_ms / measured : 0.0;
+	result["index_build_ms"] = build_ms;
+	result["index_bytes"] = (int64_t)fm_index.memory_bytes();
+	return result;
+}
+
+void Tunepal::set_cache_budget(const int64_t bytes)
+{
+	query_cache.set_budget(bytes < 0 ? 0 : bytes);
+}
+
+void Tunepal::clear_cache()
+{
+	query_cache.clear();
+}
+
+Dictionary Tunepal::get_cache_stats()
+{
+	tunepal::QueryCacheStats stats = query_cache.stats();
+	Dictionary result;
+	result["hits"] = (int64_t)stats.hits;
+	result["prefix_hits"] = (int64_t)stats.prefix_hits;
+	result["misses"] = (int64_t)stats.misses;
+	result["evictions"] = (int64_t)stats.evictions;
+	result["entries"] = (int64_t)stats.entries;
+	result["bytes"] = (int64_t)stats.bytes;
+	result["budget"] = (int64_t)stats.budget;
+	return result;
+}
+
+// Scratch arenas of every thread (see core/scratch_arena.h). Once the arenas
+// have grown to fit the queries, scratch_blocks stops increasing. Only arena
+// blocks are counted, not cache entries or result containers.
+Dictionary Tunepal::get_scratch_stats()
+{
+	Dictionary result;
+	result["scratch_blocks"] = (int64_t)tunepal::ScratchArena::blocks_allocated();
+	result["bytes"] = (int64_t)tunepal::ScratchArena::capacity();
+	return result;
+}
+
+void Tunepal::reset_segmenter(const double sample_rate)
+{
+	tunepal::SegmenterConfig config = segmenter.config();
+	config.sample_rate = sample_rate;
+	segmenter.configure(config);
+}
+
+// Frames as returned by AudioEffectCapture.get_buffer(); channels are averaged.
+// Returns the number of notes completed by this chunk.
+int Tunepal::push_audio(const PackedVector2Array frames)
+{
+	tunepal::TraceSpan span("segment audio", frames.size());
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+
+	int count = frames.size();
+	float *mono = arena.alloc<float>(count);
+	const Vector2 *in = frames.ptr();
+	for (int i = 0; i < count; i++)
+	{
+		mono[i] = 0.5f * (in[i].x + in[i].y);
+	}
+	return (int)segmenter.push(mono, count);
+}
+
+int Tunepal::push_samples(const PackedFloat32Array samples)
+{
+	tunepal::TraceSpan span("segment audio", samples.size());
+	return (int)segmenter.push(samples.ptr(), samples.size());
+}
+
+int Tunepal::finish_segmenter()
+{
+	return (int)segmenter.finish();
+}
+
+Array Tunepal::get_note_events()
+{
+	Array result;
+	const std::vector<tunepal::NoteEvent> &events = segmenter.events();
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		Dictionary event;
+		event["note"] = godot::String::chr(events[i].note);
+		event["onset"] = events[i].onset;
+		event["duration"] = events[i].duration;
+		event["frequency"] = events[i].frequency;
+		result.append(event);
+	}
+	return result;
+}
+
+godot::String Tunepal::get_segmented_query()
+{
+	return godot::String(segmenter.query().c_str());
+}
+
+double Tunepal::get_unit_length()
+{
+	return segmenter.unit_length();
+}
+
+// Nearest-rank percentiles of a set of stage timings, in milliseconds
+static Dictionary latency_summary(std::vector<double> times)
+{
+	Dictionary summary;
+	if (times.empty())
+	{
+		return summary;
+	}
+	std::sort(times.begin(), times.end());
+	double total = 0.0;
+	for (size_t i = 0; i < times.size(); i++)
+	{
+		total += times[i];
+	}
+	const double percentiles[] = { 50.0, 90.0, 99.0 };
+	const char *names[] = { "p50", "p90", "p99" };
+	for (int p = 0; p < 3; p++)
+	{
+		size_t rank = (size_t)std::ceil(percentiles[p] / 100.0 * times.size());
+		summary[names[p]] = times[std::max<size_t>(rank, 1) - 1];
+	}
+	summary["max"] = times.back();
+	summary["mean"] = total / times.size();
+	return summary;
+}
+
+// Runs recorded WAV fixtures through the same pipeline as a live recording
+// (segmentation with pitch tracking, then search) and reports per-stage
+// latency, hit rates and throughput. Fixtures run in parallel; searches skip
+// the query cache so every one is timed cold.
+Dictionary Tunepal::replay_fixtures(const PackedStringArray paths, const PackedInt32Array expected_ids, const int max_results)
+{
+	typedef std::chrono::steady_clock Clock;
+	struct Fixture {
+		PackedByteArray bytes;
+		std::string error;
+		double seconds = 0.0;
+		std::string query;
+		std::vector<SearchHit> hits;
+		int rank = -1;
+		double decode_ms = 0.0;
+		double segment_ms = 0.0;
+		double search_ms = 0.0;
+	};
+
+	Dictionary report;
+	if (paths.size() != expected_ids.size())
+	{
+		UtilityFunctions::push_error("replay_fixtures: paths and expected_ids must be the same size");
+		return report;
+	}
+
+	// Files are read up front on this thread; decoding is part of the timed pipeline
+	size_t count = paths.size();
+	std::vector<Fixture> fixtures(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		fixtures[i].bytes = FileAccess::get_file_as_bytes(paths[i]);
+		if (fixtures[i].bytes.size() == 0)
+		{
+			fixtures[i].error = "could not read file";
+		}
+	}
+
+	ensure_layout();
+	std::vector<int64_t> expected(expected_ids.ptr(), expected_ids.ptr() + count);
+	const PackedStringArray no_filter;
+	int depth = std::max(max_results, 10);
+	Clock::time_point started = Clock::now();
+	tunepal::parallel_for(count, 1, [&](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i++)
+		{
+			Fixture &fixture = fixtures[i];
+			if (!fixture.error.empty())
+			{
+				continue;
+			}
+
+			tunepal::TraceSpan span("replay fixture", (int64_t)i);
+			Clock::time_point t0 = Clock::now();
+			tunepal::WavAudio audio;
+			{
+				tunepal::TraceSpan decode("decode", (int64_t)i);
+				if (!tunepal::decode_wav(fixture.bytes.ptr(), fixture.bytes.size(), audio, fixture.error))
+				{
+					continue;
+				}
+			}
+			fixture.seconds = audio.seconds();
+
+			Clock::time_point t1 = Clock::now();
+			tunepal::SegmenterConfig config = segmenter.config();
+			config.sample_rate = audio.sample_rate;
+			tunepal::NoteSegmenter fixture_segmenter(config);
+			fixture_segmenter.push(audio.samples.data(), audio.samples.size());
+			fixture_segmenter.finish();
+			fixture.query = fixture_segmenter.query();
+
+			Clock::time_point t2 = Clock::now();
+			fixture.hits = rank_corpus(fixture.query, depth, no_filter, false);
+			Clock::time_point t3 = Clock::now();
+
+			for (size_t r = 0; r < fixture.hits.size(); r++)
+			{
+				if (corpus.id(fixture.hits[r].index) == expected[i])
+				{
+					fixture.rank = (int)r;
+					break;
+				}
+			}
+			fixture.decode_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+			fixture.segment_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+			fixture.search_ms = std::chrono::duration<double, std::milli>(t3 - t2).count();
+		}
+	});
+	double wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+
+	Array results;
+	std::vector<double> decode_times, segment_times, search_times, total_times;
+	int replayed = 0;
+	int top1 = 0;
+	int top10 = 0;
+	double audio_seconds = 0.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const Fixture &fixture = fixtures[i];
+		Dictionary result;
+		result["path"] = paths[i];
+		result["expected_id"] = expected_ids[i];
+		if (!fixture.error.empty())
+		{
+			result["error"] = godot::String(fixture.error.c_str());
+			results.append(result);
+			continue;
+		}
+
+		Array top_ids;
+		for (size_t r = 0; r < fixture.hits.size() && (int)r < max_results; r++)
+		{
+			top_ids.append(corpus.id(fixture.hits[r].index));
+		}
+		result["query"] = godot::String(fixture.query.c_str());
+		result["top_ids"] = top_ids;
+		result["rank"] = fixture.rank;
+		result["audio_seconds"] = fixture.seconds;
+		result["decode_ms"] = fixture.decode_ms;
+		result["segment_ms"] = fixture.segment_ms;
+		result["search_ms"] = fixture.search_ms;
+		results.append(result);
+
+		replayed++;
+		top1 += fixture.rank == 0;
+		top10 += fixture.rank >= 0 && fixture.rank < 10;
+		audio_seconds += fixture.seconds;
+		decode_times.push_back(fixture.decode_ms);
+		segment_times.push_back(fixture.segment_ms);
+		search_times.push_back(fixture.search_ms);
+		total_times.push_back(fixture.decode_ms + fixture.segment_ms + fixture.search_ms);
+	}
+
+	Dictionary stages;
+	stages["decode"] = latency_summary(decode_times);
+	stages["segment"] = latency_summary(segment_times);
+	stages["search"] = latency_summary(search_times);
+	stages["total"] = latency_summary(total_times);
+
+	report["fixtures"] = (int64_t)count;
+	report["replayed"] = replayed;
+	report["corpus_size"] = (int64_t)corpus.size();
+	report["workers"] = tunepal::worker_count();
+	report["top1_rate"] = replayed > 0 ? top1 / (double)replayed : 0.0;
+	report["top10_rate"] = replayed > 0 ? top10 / (double)replayed : 0.0;
+	report["wall_ms"] = wall_ms;
+	report["fixtures_per_second"] = wall_ms > 0.0 ? replayed / (wall_ms / 1000.0) : 0.0;
+	report["audio_seconds_per_second"] = wall_ms > 0.0 ? audio_seconds / (wall_ms / 1000.0) : 0.0;
+	report["stages"] = stages;
+	report["results"] = results;
+	return report;
+}
+
+// Spans from every thread, including the search workers and the corpus loader.
+// The switch and buffers are per library: TunepalExperimental traces separately.
+void Tunepal::set_tracing(const bool enabled)
+{
+	tunepal::Trace::set_enabled(enabled);
+}
+
+bool Tunepal::is_tracing()
+{
+	return tunepal::Trace::enabled();
+}
+
+void Tunepal::clear_trace()
+{
+	tunepal::Trace::clear();
+}
+
+// Writes Chrome trace-event JSON (open in ui.perfetto.dev or chrome://tracing).
+// Returns the number of spans written and dropped, or an empty Dictionary.
+Dictionary Tunepal::dump_trace(const godot::String path)
+{
+	Dictionary result;
+	Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+	if (file.is_null())
+	{
+		UtilityFunctions::push_error("dump_trace: could not write ", path);
+		return result;
 	}
-	float ed = min;
-	return ed;
+	size_t dropped = 0;
+	size_t events = tunepal::Trace::event_count(&dropped);
+	file->store_string(godot::String(tunepal::Trace::chrome_json("Tunepal").c_str()));
+	file->close();
+	result["events"] = (int64_t)events;
+	result["dropped"] = (int64_t)dropped;
+	return result;
 }
 
 void Tunepal::say_hello()
@@ -2,6 +2,28 @@
 #define TUNEPAL_H
 
 #include <godot_cpp/classes/node2d.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
+
+#include "core/abc_indexer.h"
+#include "core/corpus.h"
+#include "core/feature_index.h"
+#include "core/fm_index.h"
+#include "core/length_buckets.h"
+#include "core/note_segmenter.h"
+#include "core/query_cache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace godot {
 
@@ -9,7 +31,74 @@ class Tunepal : public Node2D {
 	GDCLASS(Tunepal, Node2D)
 
 private:
-	
+	typedef tunepal::QueryCacheEntry<uint16_t> SearchCacheEntry;
+
+	struct SearchHit {
+		uint32_t index;
+		int distance;
+	};
+
+	// Native copy of the search keys, filled from record.gd once the database is loaded
+	tunepal::Corpus corpus;
+	// One feature vector per corpus entry, for the coarse ranker
+	tunepal::FeatureIndex features;
+	// Keys copied in length order for the exhaustive scans (see core/length_buckets.h)
+	tunepal::LengthBuckets layout;
+	tunepal::QueryCache<uint16_t> query_cache;
+	int min_key_length = 50;
+	int coarse_candidates = 0;
+	int max_prefix_extension = 32;
+
+	// Seed-and-extend search (see core/fm_index.h), rebuilt when the corpus changes
+	tunepal::FmIndex fm_index;
+	int seed_length = 6;
+	int seed_band = 8;
+	int seed_clusters = 2000;
+	int max_seed_hits = 4096;
+
+	// Results that also report where in the key they matched (see core/traceback.h)
+	int match_locations = 10;
+
+	// Background corpus loading: the loader thread queues pages of rows and
+	// the main thread moves them into the corpus (see load_corpus)
+	struct LoadedPage
+	{
+		std::vector<int64_t> ids;
+		std::vector<std::string> keys;
+		std::vector<std::string> time_sigs;
+		Array rows;
+	};
+	std::thread loader;
+	std::mutex loaded_mutex;
+	std::vector<LoadedPage> loaded_pages;
+	std::atomic<bool> loading{ false };
+	std::atomic<bool> cancel_loading{ false };
+	std::atomic<int64_t> load_total{ 0 };
+	godot::String database_path;
+	// Light per-tune columns, indexed like the corpus
+	Array tune_rows;
+
+	// Search keys for tunes added as ABC on the device (see add_abc_tune)
+	tunepal::AbcIndexer abc_indexer;
+	tunepal::AbcIndexedTune abc_tune;
+
+	void load_pages(const godot::String path, const int source, const int page_size);
+	void _apply_loaded_pages();
+
+	// Turns recorded audio into a query while recording (see core/note_segmenter.h)
+	tunepal::NoteSegmenter segmenter;
+
+	std::string search_context(const PackedStringArray &time_sigs) const;
+	void ensure_layout();
+	const char *scan_key(const uint32_t index) const;
+	std::vector<uint32_t> collect_candidates(const PackedStringArray &time_sigs) const;
+	std::shared_ptr<SearchCacheEntry> score_corpus(const std::string &context, const std::string &pattern,
+			const PackedStringArray &time_sigs, const std::shared_ptr<const SearchCacheEntry> &resume_from, const bool keep_rows_allowed);
+	std::vector<SearchHit> rank_candidates(const std::string &pattern, const std::vector<uint32_t> &candidates, const size_t k) const;
+	std::vector<SearchHit> rank_corpus(const std::string &pattern, const int max_results, const PackedStringArray &time_sigs, const bool use_cache);
+	void ensure_fm_index();
+	std::vector<SearchHit> rank_seeded(const std::string &pattern, const std::vector<uint32_t> &candidates, const size_t k) const;
+	void add_match_locations(Array &results, const std::string &pattern) const;
 
 protected:
 	static void _bind_methods();
@@ -24,6 +113,68 @@ public:
 
 	int edSubstring(const godot::String needle, const godot::String haystack, const int thread_id);
 
+	// Corpus
+	void clear_corpus();
+	int add_tune(const int id, const godot::String search_key, const godot::String time_sig);
+	void add_tunes(const PackedInt32Array ids, const PackedStringArray search_keys, const PackedStringArray time_sigs);
+	int get_corpus_size();
+	void set_min_key_length(const int length);
+	int get_min_key_length();
+	Array get_length_buckets();
+	bool load_corpus(const godot::String path, const int source, const int page_size);
+	bool is_corpus_loading();
+	Array get_tune_rows();
+	Dictionary fetch_tune(const int index);
+
+	// ABC indexing (see core/abc_indexer.h)
+	Dictionary index_abc(const godot::String notation);
+	int add_abc_tune(const int id, const godot::String notation, const godot::String time_sig);
+	Dictionary reindex_notation(const godot::String path, const int source);
+	Dictionary locate_in_notation(const godot::String notation, const int start, const int end);
+
+	// Coarse ranking (see core/feature_index.h)
+	void set_coarse_candidates(const int count);
+	int get_coarse_candidates();
+	PackedInt32Array coarse_rank(const godot::String query, const int count);
+	Dictionary measure_coarse_recall(const PackedStringArray queries, const int count, const int top_k);
+
+	// Search (results are cached, see core/query_cache.h)
+	Array search(const godot::String query, const int max_results, const PackedStringArray time_sigs);
+	Array search_batch(const PackedStringArray queries, const int max_results, const PackedStringArray time_sigs);
+	Dictionary build_seed_index();
+	void set_seed_length(const int length);
+	int get_seed_length();
+	void set_seed_band(const int band);
+	int get_seed_band();
+	void set_seed_clusters(const int count);
+	int get_seed_clusters();
+	Array search_seeded(const godot::String query, const int max_results, const PackedStringArray time_sigs);
+	Dictionary compare_seeded_search(const PackedStringArray queries, const int max_results);
+	void set_match_locations(const int count);
+	int get_match_locations();
+	void set_cache_budget(const int64_t bytes);
+	void clear_cache();
+	Dictionary get_cache_stats();
+	Dictionary get_scratch_stats();
+
+	// Note segmentation
+	void reset_segmenter(const double sample_rate);
+	int push_audio(const PackedVector2Array frames);
+	int push_samples(const PackedFloat32Array samples);
+	int finish_segmenter();
+	Array get_note_events();
+	godot::String get_segmented_query();
+	double get_unit_length();
+
+	// Replay harness: recorded fixtures through segmentation and search
+	Dictionary replay_fixtures(const PackedStringArray paths, const PackedInt32Array expected_ids, const int max_results);
+
+	// Tracing: per-thread spans exported for Perfetto (see core/trace.h)
+	void set_tracing(const bool enabled);
+	bool is_tracing();
+	void clear_trace();
+	Dictionary dump_trace(const godot::String path);
+
     // int edSubstring(string
 };
 
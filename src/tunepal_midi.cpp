@@ -0,0 +1,328 @@
+#include "tunepal_midi.h"
+#include "core/scratch_arena.h"
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/audio_stream_generator.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/marshalls.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+#include<algorithm>
+#include<chrono>
+#include<string>
+#include<vector>
+
+using namespace godot;
+
+// Frames rendered per synth call; events inside a block still land on their exact frame
+static const int RENDER_BLOCK = 512;
+
+void TunepalMidi::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("load_soundfont", "path"), &TunepalMidi::load_soundfont);
+	ClassDB::bind_method(D_METHOD("load_midi", "data"), &TunepalMidi::load_midi);
+	ClassDB::bind_method(D_METHOD("load_sequence", "midi_sequence"), &TunepalMidi::load_sequence);
+
+	ClassDB::bind_method(D_METHOD("attach", "player"), &TunepalMidi::attach);
+	ClassDB::bind_method(D_METHOD("play"), &TunepalMidi::play);
+	ClassDB::bind_method(D_METHOD("stop"), &TunepalMidi::stop);
+	ClassDB::bind_method(D_METHOD("is_playing"), &TunepalMidi::is_playing);
+	ClassDB::bind_method(D_METHOD("get_length"), &TunepalMidi::get_length);
+	ClassDB::bind_method(D_METHOD("get_position"), &TunepalMidi::get_position);
+
+	ClassDB::bind_method(D_METHOD("set_max_voices", "voices"), &TunepalMidi::set_max_voices);
+	ClassDB::bind_method(D_METHOD("get_max_voices"), &TunepalMidi::get_max_voices);
+	ClassDB::bind_method(D_METHOD("get_active_voices"), &TunepalMidi::get_active_voices);
+	ClassDB::bind_method(D_METHOD("set_note_length", "seconds"), &TunepalMidi::set_note_length);
+	ClassDB::bind_method(D_METHOD("get_note_length"), &TunepalMidi::get_note_length);
+	ClassDB::bind_method(D_METHOD("set_program", "program"), &TunepalMidi::set_program);
+	ClassDB::bind_method(D_METHOD("get_program"), &TunepalMidi::get_program);
+
+	ClassDB::bind_method(D_METHOD("benchmark", "seconds", "voices"), &TunepalMidi::benchmark, DEFVAL(10.0), DEFVAL(32));
+
+	ADD_SIGNAL(MethodInfo("finished"));
+}
+
+TunepalMidi::TunepalMidi()
+{
+	synth.configure(AudioServer::get_singleton()->get_mix_rate(), 32);
+}
+
+TunepalMidi::~TunepalMidi()
+{
+}
+
+void TunepalMidi::_process(double)
+{
+	if (!playing || playback.is_null())
+	{
+		return;
+	}
+	fill_buffer();
+	if (sequencer.finished() && synth.active_voices() == 0)
+	{
+		playing = false;
+		emit_signal("finished");
+	}
+}
+
+// Tops the generator's buffer up with freshly rendered frames
+void TunepalMidi::fill_buffer()
+{
+	int frames = playback->get_frames_available();
+	if (frames <= 0)
+	{
+		return;
+	}
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+	float *block = arena.alloc<float>(2 * RENDER_BLOCK);
+	PackedVector2Array buffer;
+	buffer.resize(frames);
+	for (int done = 0; done < frames; done += RENDER_BLOCK)
+	{
+		int count = std::min(RENDER_BLOCK, frames - done);
+		sequencer.render(synth, block, count);
+		for (int i = 0; i < count; i++)
+		{
+			buffer.set(done + i, Vector2(block[2 * i], block[2 * i + 1]));
+		}
+	}
+	playback->push_buffer(buffer);
+}
+
+// An SF2 bank for the voices; without one the built-in tone plays
+bool TunepalMidi::load_soundfont(const String path)
+{
+	PackedByteArray data = FileAccess::get_file_as_bytes(path);
+	std::string error;
+	if (data.is_empty() || !soundfont.load(data.ptr(), data.size(), error))
+	{
+		UtilityFunctions::push_error("load_soundfont: ", path, ": ", error.empty() ? "could not read file" : error.c_str());
+		synth.set_soundfont(nullptr);
+		return false;
+	}
+	synth.set_soundfont(&soundfont);
+	return true;
+}
+
+// A Standard MIDI File
+bool TunepalMidi::load_midi(const PackedByteArray data)
+{
+	tunepal::MidiSong song;
+	std::string error;
+	if (!tunepal::parse_midi_file(data.ptr(), data.size(), synth.sample_rate(), song, error))
+	{
+		UtilityFunctions::push_error("load_midi: ", error.c_str());
+		return false;
+	}
+	stop();
+	sequencer.load(song);
+	return true;
+}
+
+// A tune's midi_sequence as stored in the database: a base64 SMF, or a list
+// of MIDI note numbers, or letters as in search keys (D major, one octave
+// from D4). Each number or letter lasts note_length seconds; repeats are held.
+bool TunepalMidi::load_sequence(const String midi_sequence)
+{
+	String text = midi_sequence.strip_edges();
+	if (text.begins_with("TVRoZA"))   // "MThd"
+	{
+		return load_midi(Marshalls::get_singleton()->base64_to_raw(text));
+	}
+
+	static const int LETTER_NOTES[7] = { 69, 71, 73, 62, 64, 66, 67 };   // A B C# D E F# G
+	std::vector<int> notes;
+	CharString raw = text.utf8();
+	int number = -1;
+	for (int i = 0; i <= raw.length(); i++)
+	{
+		char c = i < raw.length() ? raw.get_data()[i] : ' ';
+		if (c >= '0' && c <= '9')
+		{
+			number = (number < 0 ? 0 : number * 10) + (c - '0');
+			continue;
+		}
+		if (number >= 0)
+		{
+			notes.push_back(number);
+			number = -1;
+		}
+		if ((c >= 'A' && c <= 'G') || (c >= 'a' && c <= 'g'))
+		{
+			notes.push_back(LETTER_NOTES[(c | 0x20) - 'a']);
+		}
+	}
+	if (notes.empty())
+	{
+		return false;
+	}
+	stop();
+	sequencer.load(tunepal::midi_song_from_notes(notes, note_length, synth.sample_rate(), program));
+	return true;
+}
+
+// Plays through the given player; its stream is replaced by a generator
+void TunepalMidi::attach(AudioStreamPlayer *target)
+{
+	stop();
+	player = target;
+	if (player == nullptr)
+	{
+		return;
+	}
+	Ref<AudioStreamGenerator> generator;
+	generator.instantiate();
+	generator->set_mix_rate(synth.sample_rate());
+	generator->set_buffer_length(0.1);
+	player->set_stream(generator);
+}
+
+void TunepalMidi::play()
+{
+	if (player == nullptr)
+	{
+		UtilityFunctions::push_error("TunepalMidi.play: call attach() with an AudioStreamPlayer first");
+		return;
+	}
+	sequencer.rewind();
+	synth.set_soundfont(soundfont.empty() ? nullptr : &soundfont);
+	player->play();
+	playback = player->get_stream_playback();
+	if (playback.is_null())
+	{
+		return;
+	}
+	playing = true;
+	set_process(true);
+	fill_buffer();
+}
+
+void TunepalMidi::stop()
+{
+	playing = false;
+	if (player != nullptr)
+	{
+		player->stop();
+	}
+	playback.unref();
+	synth.reset();
+}
+
+bool TunepalMidi::is_playing()
+{
+	return playing;
+}
+
+// Seconds up to the last event
+double TunepalMidi::get_length()
+{
+	return sequencer.song().seconds();
+}
+
+// Seconds rendered so far (ahead of what is audible by the generator buffer)
+double TunepalMidi::get_position()
+{
+	return sequencer.position() / synth.sample_rate();
+}
+
+// Polyphony limit; past it the quietest releasing or oldest voice is stolen
+void TunepalMidi::set_max_voices(const int voices)
+{
+	stop();
+	synth.configure(synth.sample_rate(), std::max(voices, 1));
+	synth.set_soundfont(soundfont.empty() ? nullptr : &soundfont);
+}
+
+int TunepalMidi::get_max_voices()
+{
+	return synth.max_voices();
+}
+
+int TunepalMidi::get_active_voices()
+{
+	return synth.active_voices();
+}
+
+void TunepalMidi::set_note_length(const double seconds)
+{
+	note_length = std::max(seconds, 0.01);
+}
+
+double TunepalMidi::get_note_length()
+{
+	return note_length;
+}
+
+// General MIDI program for note lists and letter sequences
+void TunepalMidi::set_program(const int number)
+{
+	program = std::max(0, std::min(number, 127));
+}
+
+int TunepalMidi::get_program()
+{
+	return program;
+}
+
+// Renders offline, without an audio device: the loaded song (looped to fill
+// `seconds`) or, if none is loaded, a chord of `voices` notes struck every
+// quarter second. voices_per_cpu_ms is milliseconds of single-voice audio
+// rendered per millisecond of CPU, i.e. how many voices could play in real time.
+Dictionary TunepalMidi::benchmark(const double seconds, const int voices)
+{
+	typedef std::chrono::steady_clock Clock;
+	double rate = synth.sample_rate();
+	uint64_t total = (uint64_t)(std::max(seconds, 0.1) * rate);
+
+	tunepal::Synth offline(rate, std::max(voices, 1));
+	offline.set_soundfont(soundfont.empty() ? nullptr : &soundfont);
+	tunepal::MidiSong song = sequencer.song();
+	if (song.events.empty())
+	{
+		song.sample_rate = rate;
+		for (uint64_t frame = 0; frame < total; frame += (uint64_t)(0.25 * rate))
+		{
+			for (int v = 0; v < std::max(voices, 1); v++)
+			{
+				tunepal::MidiEvent note = { frame, 0x90, (uint8_t)(36 + v % 60), 100 };
+				song.events.push_back(note);
+			}
+		}
+		song.length_frames = total;
+	}
+	tunepal::MidiSequencer bench;
+	bench.load(song);
+
+	tunepal::ScratchArena &arena = tunepal::ScratchArena::local();
+	tunepal::ScratchArena::Scope scope(arena);
+	float *block = arena.alloc<float>(2 * RENDER_BLOCK);
+	double voice_frames = 0.0;
+	int peak = 0;
+	Clock::time_point start = Clock::now();
+	for (uint64_t done = 0; done < total; done += RENDER_BLOCK)
+	{
+		if (bench.finished() && offline.active_voices() == 0)
+		{
+			bench.rewind();
+		}
+		int count = (int)std::min<uint64_t>(RENDER_BLOCK, total - done);
+		bench.render(offline, block, count);
+		int active = offline.active_voices();
+		voice_frames += (double)active * count;
+		peak = std::max(peak, active);
+	}
+	double cpu_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	double audio_ms = total * 1000.0 / rate;
+
+	Dictionary result;
+	result["audio_ms"] = audio_ms;
+	result["cpu_ms"] = cpu_ms;
+	result["realtime_factor"] = cpu_ms > 0.0 ? audio_ms / cpu_ms : 0.0;
+	result["max_voices"] = offline.max_voices();
+	result["peak_voices"] = peak;
+	result["mean_voices"] = voice_frames / total;
+	result["voices_per_cpu_ms"] = cpu_ms > 0.0 ? voice_frames * 1000.0 / rate / cpu_ms : 0.0;
+	result["soundfont"] = !soundfont.empty();
+	return result;
+}
@@ -0,0 +1,66 @@
+#ifndef TUNEPAL_MIDI_H
+#define TUNEPAL_MIDI_H
+
+#include <godot_cpp/classes/audio_stream_generator_playback.hpp>
+#include <godot_cpp/classes/audio_stream_player.hpp>
+#include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+
+#include "core/midi_file.h"
+#include "core/soundfont.h"
+#include "core/synth.h"
+
+namespace godot {
+
+// Native MIDI playback: SMF files or a tune's midi_sequence, rendered by the
+// SoundFont synth (see core/synth.h) into an AudioStreamGenerator
+class TunepalMidi : public Node {
+	GDCLASS(TunepalMidi, Node)
+
+private:
+	tunepal::SoundFont soundfont;
+	tunepal::Synth synth;
+	tunepal::MidiSequencer sequencer;
+	AudioStreamPlayer *player = nullptr;
+	Ref<AudioStreamGeneratorPlayback> playback;
+	bool playing = false;
+	double note_length = 0.2;
+	int program = 73;   // General MIDI flute
+
+	void fill_buffer();
+
+protected:
+	static void _bind_methods();
+
+public:
+	TunepalMidi();
+	~TunepalMidi();
+
+	void _process(double delta) override;
+
+	bool load_soundfont(const String path);
+	bool load_midi(const PackedByteArray data);
+	bool load_sequence(const String midi_sequence);
+
+	void attach(AudioStreamPlayer *target);
+	void play();
+	void stop();
+	bool is_playing();
+	double get_length();
+	double get_position();
+
+	void set_max_voices(const int voices);
+	int get_max_voices();
+	int get_active_voices();
+	void set_note_length(const double seconds);
+	double get_note_length();
+	void set_program(const int number);
+	int get_program();
+
+	Dictionary benchmark(const double seconds, const int voices);
+};
+
+}
+
+#endif
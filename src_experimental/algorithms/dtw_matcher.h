@@ -14,6 +14,10 @@
 #include <cmath>
 #include <algorithm>
 #include <limits>
+#include <string>
+
+#include "core/alignment.h"
+#include "core/scratch_arena.h"
 
 namespace tunepal_exp {
 
@@ -30,16 +34,22 @@ public:
      * @return DTW distance (lower = more similar)
      */
     float distance(const std::vector<float>& seq1, const std::vector<float>& seq2) {
-        if (seq1.empty() || seq2.empty()) {
+        return distance(seq1.data(), static_cast<int>(seq1.size()),
+                        seq2.data(), static_cast<int>(seq2.size()));
+    }
+
+    float distance(const float* seq1, int n, const float* seq2, int m) {
+        if (n == 0 || m == 0) {
             return std::numeric_limits<float>::infinity();
         }
 
-        int n = static_cast<int>(seq1.size());
-        int m = static_cast<int>(seq2.size());
-
-        // Use 2-row optimization for memory efficiency
-        std::vector<float> prev_row(m + 1, std::numeric_limits<float>::infinity());
-        std::vector<float> curr_row(m + 1, std::numeric_limits<float>::infinity());
+        // Use 2-row optimization for memory efficiency, rows from the scratch arena
+        tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+        tunepal::ScratchArena::Scope scope(arena);
+        float* prev_row = arena.alloc<float>(m + 1);
+        float* curr_row = arena.alloc<float>(m + 1);
+        std::fill(prev_row, prev_row + m + 1, std::numeric_limits<float>::infinity());
+        std::fill(curr_row, curr_row + m + 1, std::numeric_limits<float>::infinity());
 
         prev_row[0] = 0.0f;
 
@@ -106,33 +116,19 @@ public:
         int n = static_cast<int>(pattern.size());
         int m = static_cast<int>(text.size());
 
-        // For subsequence matching, we allow starting anywhere in text
-        std::vector<float> prev_row(m + 1, 0.0f);  // Initialize to 0 (can start anywhere)
-        std::vector<float> curr_row(m + 1, 0.0f);
-
-        for (int i = 1; i <= n; i++) {
-            curr_row[0] = std::numeric_limits<float>::infinity();
-
-            for (int j = 1; j <= m; j++) {
-                float cost = std::abs(pattern[i - 1] - text[j - 1]);
-
-                float min_prev = std::min({
-                    prev_row[j - 1],  // diagonal
-                    prev_row[j],      // vertical
-                    curr_row[j - 1]   // horizontal
-                });
-
-                curr_row[j] = cost + min_prev;
-            }
-
-            std::swap(prev_row, curr_row);
-        }
-
-        // Find minimum in last row (pattern can end anywhere)
-        float min_dist = *std::min_element(prev_row.begin() + 1, prev_row.end());
+        float min_dist = tunepal::SubsequenceDtwAligner::align(pattern.data(), n, text.data(), m);
+        return distance_to_similarity(min_dist, n);
+    }
 
+    /**
+     * Convert a subsequence DTW distance into a similarity
+     * @param min_dist Best distance in the last row (see SubsequenceDtwAligner)
+     * @param pattern_length Number of pattern notes aligned
+     * @return Similarity between 0.0 and 1.0
+     */
+    static float distance_to_similarity(float min_dist, int pattern_length) {
         // Normalize and convert to similarity
-        float normalized = min_dist / static_cast<float>(n);
+        float normalized = min_dist / static_cast<float>(pattern_length);
         return std::exp(-normalized / 2.0f);
     }
 
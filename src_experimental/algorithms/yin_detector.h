@@ -14,6 +14,9 @@
 
 #include <vector>
 #include <cmath>
+#include <cstddef>
+
+#include "core/scratch_arena.h"
 
 namespace tunepal_exp {
 
@@ -37,34 +40,47 @@ public:
      * @return YinResult with frequency, confidence, and period
      */
     YinResult detect(const std::vector<float>& samples) {
+        return detect(samples.data(), samples.size());
+    }
+
+    /**
+     * Detect pitch from a window of a larger buffer, without copying it
+     * @param samples First sample of the window
+     * @param sample_count Window length
+     */
+    YinResult detect(const float* samples, size_t sample_count) {
         YinResult result = {-1.0f, 0.0f, 0};
 
-        if (samples.size() < 64) {
+        if (sample_count < 64) {
             return result;
         }
 
+        // Working buffers come from the thread's scratch arena
+        tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+        tunepal::ScratchArena::Scope scope(arena);
+
         // Calculate tau range from frequency limits
         int tau_min = static_cast<int>(sample_rate / max_frequency);
         int tau_max = static_cast<int>(sample_rate / min_frequency);
 
         // Ensure we don't exceed buffer limits
-        int max_tau = static_cast<int>(samples.size() / 2);
+        int max_tau = static_cast<int>(sample_count / 2);
         if (tau_max > max_tau) tau_max = max_tau;
         if (tau_min < 2) tau_min = 2;
         if (tau_max <= tau_min) return result;
 
         // Step 1 & 2: Difference function
-        std::vector<float> diff(tau_max);
+        float* diff = arena.alloc<float>(tau_max);
         for (int tau = 0; tau < tau_max; tau++) {
             diff[tau] = 0.0f;
-            for (size_t i = 0; i < samples.size() - tau_max; i++) {
+            for (size_t i = 0; i < sample_count - tau_max; i++) {
                 float delta = samples[i] - samples[i + tau];
                 diff[tau] += delta * delta;
             }
         }
 
         // Step 3: Cumulative Mean Normalized Difference Function (CMNDF)
-        std::vector<float> cmndf(tau_max);
+        float* cmndf = arena.alloc<float>(tau_max);
         cmndf[0] = 1.0f;
         float running_sum = 0.0f;
 
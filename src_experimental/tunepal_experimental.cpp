@@ -8,6 +8,11 @@
 #include "tunepal_experimental.h"
 #include "algorithms/yin_detector.h"
 #include "algorithms/dtw_matcher.h"
+#include "core/alignment.h"
+#include "core/batch_scoring.h"
+#include "core/scratch_arena.h"
+#include "core/trace.h"
+#include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
 
@@ -44,6 +49,24 @@ void TunepalExperimental::_bind_methods() {
                          &TunepalExperimental::dtw_similarity);
     ClassDB::bind_method(D_METHOD("dtw_search", "pattern", "candidates", "max_results"),
                          &TunepalExperimental::dtw_search);
+    ClassDB::bind_method(D_METHOD("dtw_search_batch", "patterns", "candidates", "max_results"),
+                         &TunepalExperimental::dtw_search_batch);
+    ClassDB::bind_method(D_METHOD("set_dtw_cache_budget", "bytes"),
+                         &TunepalExperimental::set_dtw_cache_budget);
+    ClassDB::bind_method(D_METHOD("clear_dtw_cache"),
+                         &TunepalExperimental::clear_dtw_cache);
+    ClassDB::bind_method(D_METHOD("get_dtw_cache_stats"),
+                         &TunepalExperimental::get_dtw_cache_stats);
+
+    // Tracing
+    ClassDB::bind_method(D_METHOD("set_tracing", "enabled"),
+                         &TunepalExperimental::set_tracing);
+    ClassDB::bind_method(D_METHOD("is_tracing"),
+                         &TunepalExperimental::is_tracing);
+    ClassDB::bind_method(D_METHOD("clear_trace"),
+                         &TunepalExperimental::clear_trace);
+    ClassDB::bind_method(D_METHOD("dump_trace", "path"),
+                         &TunepalExperimental::dump_trace);
 
     // Needleman-Wunsch (for comparison with Bryan's algorithm)
     ClassDB::bind_method(D_METHOD("needleman_wunsch", "pattern", "text"),
@@ -93,19 +116,13 @@ float TunepalExperimental::detect_pitch_pyin(const PackedFloat32Array& audio_buf
         return -1.0f;
     }
 
-    // Copy to std::vector for our algorithm
-    std::vector<float> samples(audio_buffer.size());
-    for (int i = 0; i < audio_buffer.size(); i++) {
-        samples[i] = audio_buffer[i];
-    }
-
     // Configure detector
     yin_detector.sample_rate = pitch_config_.sample_rate;
     yin_detector.min_frequency = pitch_config_.min_frequency;
     yin_detector.max_frequency = pitch_config_.max_frequency;
 
     // Detect pitch
-    auto result = yin_detector.detect(samples);
+    auto result = yin_detector.detect(audio_buffer.ptr(), audio_buffer.size());
     last_confidence_ = result.confidence;
 
     return result.frequency;
@@ -128,16 +145,11 @@ Array TunepalExperimental::detect_pitch_sequence(const PackedFloat32Array& audio
     int num_frames = (audio_data.size() - frame_size) / hop_size + 1;
 
     for (int frame = 0; frame < num_frames; frame++) {
+        tunepal::TraceSpan span("pitch frame", frame);
         int start = frame * hop_size;
 
-        // Extract frame
-        std::vector<float> samples(frame_size);
-        for (int i = 0; i < frame_size; i++) {
-            samples[i] = audio_data[start + i];
-        }
-
-        // Detect pitch
-        auto result = yin_detector.detect(samples);
+        // Detect pitch on the frame in place
+        auto result = yin_detector.detect(audio_data.ptr() + start, frame_size);
 
         // Create result dictionary
         Dictionary frame_result;
@@ -175,61 +187,291 @@ void TunepalExperimental::set_pitch_algorithm(int algorithm) {
 
 float TunepalExperimental::dtw_distance(const PackedFloat32Array& seq1,
                                          const PackedFloat32Array& seq2) {
-    std::vector<float> s1(seq1.size());
-    std::vector<float> s2(seq2.size());
-
-    for (int i = 0; i < seq1.size(); i++) s1[i] = seq1[i];
-    for (int i = 0; i < seq2.size(); i++) s2[i] = seq2[i];
-
-    return dtw_matcher.distance(s1, s2);
+    return dtw_matcher.distance(seq1.ptr(), static_cast<int>(seq1.size()),
+                                seq2.ptr(), static_cast<int>(seq2.size()));
 }
 
 float TunepalExperimental::dtw_similarity(const String& pattern, const String& text) {
+    tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+    tunepal::ScratchArena::Scope scope(arena);
+
     // Convert note strings to sequences
-    std::vector<float> p = string_to_pitch_sequence(pattern);
-    std::vector<float> t = string_to_pitch_sequence(text);
+    float* p;
+    float* t;
+    int n = string_to_pitch_sequence(pattern, p);
+    int m = string_to_pitch_sequence(text, t);
 
-    if (p.empty() || t.empty()) return 0.0f;
+    if (n == 0 || m == 0) return 0.0f;
 
     // Use subsequence matching for melody search
-    return dtw_matcher.subsequence_match(p, t);
+    if (n > m) return 0.0f;
+    float min_dist = tunepal::SubsequenceDtwAligner::align(p, n, t, m);
+    return tunepal_exp::DtwMatcher::distance_to_similarity(min_dist, n);
 }
 
 Array TunepalExperimental::dtw_search(const String& pattern, const Array& candidates,
                                        int max_results) {
+    tunepal::TraceSpan span("dtw search");
     Array results;
 
-    std::vector<float> pattern_seq = string_to_pitch_sequence(pattern);
-    if (pattern_seq.empty()) return results;
+    tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+    tunepal::ScratchArena::Scope scope(arena);
 
-    // Score all candidates
-    std::vector<std::pair<float, int>> scores;
+    float* pattern_seq;
+    int pattern_length = string_to_pitch_sequence(pattern, pattern_seq);
+    if (pattern_length == 0) return results;
+
+    // The cache key is the note letters the matcher actually sees; the context
+    // identifies the candidate list by a FNV-1a fingerprint of its contents
+    std::string query;
+    for (int i = 0; i < pattern.length(); i++) {
+        char32_t c = pattern[i];
+        if (c >= 'a' && c <= 'g') c -= 'a' - 'A';
+        if (c >= 'A' && c <= 'G') query.push_back(static_cast<char>(c));
+    }
+
+    uint64_t fingerprint = 1469598103934665603ULL;
     for (int i = 0; i < candidates.size(); i++) {
         String candidate = candidates[i];
-        std::vector<float> candidate_seq = string_to_pitch_sequence(candidate);
-
-        if (!candidate_seq.empty()) {
-            float sim = dtw_matcher.subsequence_match(pattern_seq, candidate_seq);
-            scores.push_back({sim, i});
+        CharString bytes = candidate.utf8();
+        for (int b = 0; b < bytes.length(); b++) {
+            fingerprint = (fingerprint ^ static_cast<uint8_t>(bytes.get_data()[b])) * 1099511628211ULL;
         }
+        fingerprint = (fingerprint ^ 0xFF) * 1099511628211ULL;
+    }
+    std::string context = "dtw|" + std::to_string(candidates.size()) + "|" + std::to_string(fingerprint);
+
+    std::shared_ptr<const tunepal::QueryCacheEntry<float>> entry = dtw_cache_.find(context, query);
+    if (!entry) {
+        auto prefix = dtw_cache_.find_prefix(context, query, max_prefix_extension_);
+        auto scored = score_dtw_candidates(context, query, pattern_seq, pattern_length,
+                                           candidates, prefix);
+        dtw_cache_.insert(scored);
+        entry = scored;
     }
 
     // Sort by similarity (descending)
-    std::sort(scores.begin(), scores.end(),
-              [](const auto& a, const auto& b) { return a.first > b.first; });
+    int candidate_count = static_cast<int>(entry->candidates.size());
+    tunepal::TraceSpan merge("merge", candidate_count);
+    int* order = arena.alloc<int>(candidate_count);
+    for (int i = 0; i < candidate_count; i++) order[i] = i;
+    std::sort(order, order + candidate_count, [&](int a, int b) {
+        if (entry->scores[a] != entry->scores[b]) return entry->scores[a] > entry->scores[b];
+        return a < b;
+    });
 
     // Return top results
-    int count = std::min(max_results, static_cast<int>(scores.size()));
+    int count = std::min(max_results, candidate_count);
+    tunepal::TraceSpan hydrate("hydrate results", count);
     for (int i = 0; i < count; i++) {
         Dictionary result;
-        result["index"] = scores[i].second;
-        result["similarity"] = scores[i].first;
+        result["index"] = entry->candidates[order[i]];
+        result["similarity"] = entry->scores[order[i]];
         results.append(result);
     }
 
     return results;
 }
 
+Array TunepalExperimental::dtw_search_batch(const PackedStringArray& patterns, const Array& candidates,
+                                             int max_results) {
+    tunepal::TraceSpan span("dtw search batch", patterns.size());
+    Array results;
+
+    tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+    tunepal::ScratchArena::Scope scope(arena);
+
+    // Sequences are converted once; the workers only read them
+    int pattern_count = patterns.size();
+    float** pattern_seqs = arena.alloc<float*>(pattern_count);
+    int* pattern_lengths = arena.alloc<int>(pattern_count);
+    for (int q = 0; q < pattern_count; q++) {
+        pattern_lengths[q] = string_to_pitch_sequence(patterns[q], pattern_seqs[q]);
+    }
+
+    // Like dtw_search, candidates without notes are never reported
+    int candidate_total = static_cast<int>(candidates.size());
+    float** candidate_seqs = arena.alloc<float*>(candidate_total);
+    int* candidate_lengths = arena.alloc<int>(candidate_total);
+    int* candidate_index = arena.alloc<int>(candidate_total);
+    int candidate_count = 0;
+    for (int i = 0; i < candidate_total; i++) {
+        String candidate = candidates[i];
+        int length = string_to_pitch_sequence(candidate, candidate_seqs[candidate_count]);
+        if (length > 0) {
+            candidate_lengths[candidate_count] = length;
+            candidate_index[candidate_count] = i;
+            candidate_count++;
+        }
+    }
+
+    size_t k = max_results > 0 ? static_cast<size_t>(max_results) : 0;
+    auto hits = tunepal::score_batch<float>(
+        pattern_count, candidate_count, k, false,
+        [&](size_t c) { return static_cast<size_t>(candidate_lengths[c]) * 2 * sizeof(float); },
+        [&](size_t q, size_t c, const float* cutoff, float& similarity) {
+            int n = pattern_lengths[q];
+            int m = candidate_lengths[c];
+            if (n == 0) return false;
+            if (n > m) {
+                similarity = 0.0f;
+                return true;
+            }
+
+            tunepal::ScratchArena& local = tunepal::ScratchArena::local();
+            tunepal::ScratchArena::Scope row_scope(local);
+            float* row = local.alloc<float>(m + 1);
+            tunepal::SubsequenceDtwAligner::init_row(row, m);
+            if (cutoff != nullptr && *cutoff > 0.0f) {
+                // Invert distance_to_similarity; the slack keeps rounding from dropping a tie
+                float max_distance = -2.0f * n * std::log(*cutoff) * 1.0001f + 1e-4f;
+                if (!tunepal::SubsequenceDtwAligner::advance_bounded(row, 0, pattern_seqs[q], n,
+                                                                     candidate_seqs[c], m, max_distance)) {
+                    return false;
+                }
+            } else {
+                tunepal::SubsequenceDtwAligner::advance(row, 0, pattern_seqs[q], n, candidate_seqs[c], m);
+            }
+            similarity = tunepal_exp::DtwMatcher::distance_to_similarity(
+                tunepal::SubsequenceDtwAligner::finish(row, m), n);
+            return true;
+        });
+
+    tunepal::TraceSpan hydrate("hydrate results");
+    for (int q = 0; q < pattern_count; q++) {
+        Array pattern_results;
+        for (size_t i = 0; i < hits[q].size(); i++) {
+            Dictionary result;
+            result["index"] = candidate_index[hits[q][i].index];
+            result["similarity"] = hits[q][i].score;
+            pattern_results.append(result);
+        }
+        results.append(pattern_results);
+    }
+    return results;
+}
+
+std::shared_ptr<tunepal::QueryCacheEntry<float>> TunepalExperimental::score_dtw_candidates(
+    const std::string& context, const std::string& query,
+    const float* pattern_seq, int pattern_length, const Array& candidates,
+    const std::shared_ptr<const tunepal::QueryCacheEntry<float>>& resume_from) {
+    auto entry = std::make_shared<tunepal::QueryCacheEntry<float>>();
+    entry->context = context;
+    entry->query = query;
+
+    tunepal::ScratchArena& arena = tunepal::ScratchArena::local();
+    tunepal::ScratchArena::Scope scope(arena);
+
+    // Candidate sequences, converted once into the arena
+    int candidate_total = static_cast<int>(candidates.size());
+    float** candidate_seqs = arena.alloc<float*>(candidate_total);
+    int* candidate_lengths = arena.alloc<int>(candidate_total);
+    size_t cells = 0;
+    for (int i = 0; i < candidate_total; i++) {
+        String candidate = candidates[i];
+        int length = string_to_pitch_sequence(candidate, candidate_seqs[entry->candidates.size()]);
+
+        if (length > 0) {
+            candidate_lengths[entry->candidates.size()] = length;
+            entry->candidates.push_back(static_cast<uint32_t>(i));
+            entry->row_offsets.push_back(static_cast<uint32_t>(cells));
+            cells += length + 1;
+        }
+    }
+
+    // Keep the rows only when they fit the budget; otherwise score from scratch
+    bool keep_rows = cells * sizeof(float) <= dtw_cache_.budget();
+    int rows_done = 0;
+    if (keep_rows && resume_from && resume_from->has_rows()) {
+        entry->rows = resume_from->rows;
+        rows_done = static_cast<int>(resume_from->query.size());
+    } else if (keep_rows) {
+        entry->rows.resize(cells);
+    } else {
+        entry->row_offsets.clear();
+    }
+
+    int n = pattern_length;
+    tunepal::TraceSpan span("score candidates", static_cast<int64_t>(entry->candidates.size()));
+    entry->scores.resize(entry->candidates.size());
+    for (size_t c = 0; c < entry->candidates.size(); c++) {
+        tunepal::ScratchArena::Scope row_scope(arena);
+        const float* text = candidate_seqs[c];
+        int m = candidate_lengths[c];
+
+        float* row;
+        if (keep_rows) {
+            row = entry->rows.data() + entry->row_offsets[c];
+        } else {
+            row = arena.alloc<float>(m + 1);
+        }
+        if (rows_done == 0) {
+            tunepal::SubsequenceDtwAligner::init_row(row, m);
+        }
+        tunepal::SubsequenceDtwAligner::advance(row, rows_done, pattern_seq + rows_done,
+                                                n - rows_done, text, m);
+        // A pattern longer than the candidate cannot match (see subsequence_match)
+        entry->scores[c] = n > m ? 0.0f : tunepal_exp::DtwMatcher::distance_to_similarity(
+            tunepal::SubsequenceDtwAligner::finish(row, m), n);
+    }
+
+    return entry;
+}
+
+void TunepalExperimental::set_dtw_cache_budget(int64_t bytes) {
+    dtw_cache_.set_budget(bytes < 0 ? 0 : static_cast<size_t>(bytes));
+}
+
+void TunepalExperimental::clear_dtw_cache() {
+    dtw_cache_.clear();
+}
+
+Dictionary TunepalExperimental::get_dtw_cache_stats() {
+    tunepal::QueryCacheStats stats = dtw_cache_.stats();
+    Dictionary result;
+    result["hits"] = static_cast<int64_t>(stats.hits);
+    result["prefix_hits"] = static_cast<int64_t>(stats.prefix_hits);
+    result["misses"] = static_cast<int64_t>(stats.misses);
+    result["evictions"] = static_cast<int64_t>(stats.evictions);
+    result["entries"] = static_cast<int64_t>(stats.entries);
+    result["bytes"] = static_cast<int64_t>(stats.bytes);
+    result["budget"] = static_cast<int64_t>(stats.budget);
+    return result;
+}
+
+// ========================================
+// Tracing
+// ========================================
+
+// Spans are per library: this switch and buffers are separate from Tunepal's
+void TunepalExperimental::set_tracing(bool enabled) {
+    tunepal::Trace::set_enabled(enabled);
+}
+
+bool TunepalExperimental::is_tracing() {
+    return tunepal::Trace::enabled();
+}
+
+void TunepalExperimental::clear_trace() {
+    tunepal::Trace::clear();
+}
+
+Dictionary TunepalExperimental::dump_trace(const String& path) {
+    Dictionary result;
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::push_error("dump_trace: could not write ", path);
+        return result;
+    }
+    size_t dropped = 0;
+    size_t events = tunepal::Trace::event_count(&dropped);
+    file->store_string(String(tunepal::Trace::chrome_json("TunepalExperimental").c_str()));
+    file->close();
+    result["events"] = static_cast<int64_t>(events);
+    result["dropped"] = static_cast<int64_t>(dropped);
+    return result;
+}
+
 // ========================================
 // Needleman-Wunsch (for comparison)
 // ========================================
@@ -244,31 +486,8 @@ float TunepalExperimental::needleman_wunsch(const String& pattern, const String&
     if (m == 0) return static_cast<float>(n);
     if (n == 0) return static_cast<float>(m);
 
-    // Use 2-row optimization
-    std::vector<int> prev_row(n + 1);
-    std::vector<int> curr_row(n + 1);
-
-    // Initialize - for substring matching, start cost is 0
-    for (int j = 0; j <= n; j++) prev_row[j] = 0;
-
-    for (int i = 1; i <= m; i++) {
-        curr_row[0] = i;  // Deletion cost
-
-        for (int j = 1; j <= n; j++) {
-            int cost = (pattern[i - 1] == text[j - 1]) ? 0 : 1;
-
-            curr_row[j] = std::min({
-                prev_row[j] + 1,      // Deletion
-                curr_row[j - 1] + 1,  // Insertion
-                prev_row[j - 1] + cost // Substitution
-            });
-        }
-
-        std::swap(prev_row, curr_row);
-    }
-
-    // Find minimum in last row (substring matching)
-    int min_dist = *std::min_element(prev_row.begin(), prev_row.end());
+    // Substring matching: free start and end in text (see core/alignment.h)
+    int min_dist = tunepal::EditDistanceAligner::align(pattern.ptr(), m, text.ptr(), n);
 
     return static_cast<float>(min_dist);
 }
@@ -303,9 +522,9 @@ float TunepalExperimental::midi_to_frequency(int midi_note) {
     return 440.0f * std::pow(2.0f, (midi_note - 69) / 12.0f);
 }
 
-std::vector<float> TunepalExperimental::string_to_pitch_sequence(const String& note_string) {
-    std::vector<float> seq;
-    seq.reserve(note_string.length());
+int TunepalExperimental::string_to_pitch_sequence(const String& note_string, float*& out) {
+    out = tunepal::ScratchArena::local().alloc<float>(note_string.length());
+    int count = 0;
 
     for (int i = 0; i < note_string.length(); i++) {
         char32_t c = note_string[i];
@@ -322,9 +541,9 @@ std::vector<float> TunepalExperimental::string_to_pitch_sequence(const String& n
         }
 
         if (value >= 0.0f) {
-            seq.push_back(value);
+            out[count++] = value;
         }
     }
 
-    return seq;
+    return count;
 }
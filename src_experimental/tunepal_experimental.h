@@ -16,11 +16,15 @@
 
 #include <godot_cpp/classes/node2d.hpp>
 #include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/array.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/string.hpp>
+#include "core/query_cache.h"
 #include <vector>
 #include <map>
+#include <memory>
+#include <string>
 
 namespace godot {
 
@@ -40,6 +44,10 @@ private:
     PitchConfig pitch_config_;
     float last_confidence_ = 0.0f;
 
+    // Cached dtw_search results; see core/query_cache.h
+    tunepal::QueryCache<float> dtw_cache_;
+    int max_prefix_extension_ = 32;
+
 protected:
     static void _bind_methods();
 
@@ -71,6 +79,21 @@ public:
     float dtw_distance(const PackedFloat32Array& seq1, const PackedFloat32Array& seq2);
     float dtw_similarity(const String& pattern, const String& text);
     Array dtw_search(const String& pattern, const Array& candidates, int max_results);
+    // Many patterns in one pass over the candidates; per-pattern results as dtw_search
+    Array dtw_search_batch(const PackedStringArray& patterns, const Array& candidates, int max_results);
+
+    // dtw_search result cache
+    void set_dtw_cache_budget(int64_t bytes);
+    void clear_dtw_cache();
+    Dictionary get_dtw_cache_stats();
+
+    // ========================================
+    // Tracing (spans for Perfetto, see core/trace.h)
+    // ========================================
+    void set_tracing(bool enabled);
+    bool is_tracing();
+    void clear_trace();
+    Dictionary dump_trace(const String& path);
 
     // ========================================
     // Needleman-Wunsch (fallback, for comparison)
@@ -88,7 +111,12 @@ private:
     // Internal helpers
     int frequency_to_midi(float frequency);
     float midi_to_frequency(int midi_note);
-    std::vector<float> string_to_pitch_sequence(const String& note_string);
+    // Writes into the calling thread's scratch arena; returns the note count
+    int string_to_pitch_sequence(const String& note_string, float*& out);
+    std::shared_ptr<tunepal::QueryCacheEntry<float>> score_dtw_candidates(
+        const std::string& context, const std::string& query,
+        const float* pattern_seq, int pattern_length, const Array& candidates,
+        const std::shared_ptr<const tunepal::QueryCacheEntry<float>>& resume_from);
 };
 
 } // namespace godot